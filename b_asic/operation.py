@@ -27,6 +27,7 @@ from typing import (
 
 from b_asic.graph_component import AbstractGraphComponent, GraphComponent, GraphID, Name
 from b_asic.port import InputPort, OutputPort, SignalSourceProvider
+from b_asic.quantization import quantize
 from b_asic.signal import Signal
 from b_asic.types import Num
 
@@ -842,19 +843,35 @@ class AbstractOperation(Operation, AbstractGraphComponent):
         """
         Quantize the values to be used as inputs to the bit lengths specified
         by the respective signals connected to each input.
+
+        Signals with :attr:`~b_asic.signal.Signal.fractional_bits` set quantize to
+        their fixed-point format instead, unless *bits_override* is given.
         """
         args = []
         for i, input_port in enumerate(self.inputs):
             value = input_values[i]
-            if bits_override is None and input_port.signal_count >= 1:
-                bits_override = input_port.signals[0].bits
-            if bits_override is not None:
+            bits = bits_override
+            if bits is None and input_port.signal_count >= 1:
+                signal = input_port.signals[0]
+                if signal.fractional_bits is not None:
+                    args.append(
+                        quantize(
+                            value,
+                            signal.fractional_bits,
+                            signal.integer_bits,
+                            signal.quantization,
+                            signal.overflow,
+                        )
+                    )
+                    continue
+                bits = signal.bits
+            if bits is not None:
                 if isinstance(value, complex):
                     raise TypeError(
-                        "Complex value cannot be quantized to {bits} bits as"
-                        " requested by the signal connected to input #{i}"
+                        f"Complex value cannot be quantized to {bits} bits as"
+                        f" requested by the signal connected to input #{i}"
                     )
-                value = self.quantize_input(i, value, bits_override)
+                value = self.quantize_input(i, value, bits)
             args.append(value)
         return args
 
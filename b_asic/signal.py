@@ -6,6 +6,7 @@ Contains the class for representing the connections between operations.
 from typing import TYPE_CHECKING, Iterable, Optional, Union
 
 from b_asic.graph_component import AbstractGraphComponent, GraphComponent
+from b_asic.quantization import Overflow, Quantization
 from b_asic.types import Name, TypeName
 
 if TYPE_CHECKING:
@@ -207,6 +208,98 @@ class Signal(AbstractGraphComponent):
                 raise ValueError("Bits cannot be negative")
         self.set_param("bits", bits)
 
+    @property
+    def fractional_bits(self) -> Optional[int]:
+        """
+        Get the number of fractional bits of the fixed-point format that operations
+        using this signal as an input should quantize received values to.
+        None = no fixed-point format.
+
+        When set, values are quantized using :func:`~b_asic.quantization.quantize`
+        with :attr:`integer_bits`, :attr:`quantization` and :attr:`overflow`, instead
+        of to :attr:`bits`.
+        """
+        return self.param("fractional_bits")
+
+    @fractional_bits.setter
+    def fractional_bits(self, fractional_bits: Optional[int]) -> None:
+        """
+        Set the number of fractional bits of the fixed-point format that operations
+        using this signal as an input should quantize received values to.
+        None = no fixed-point format.
+        """
+        if fractional_bits is not None and not isinstance(fractional_bits, int):
+            raise TypeError(
+                "Fractional bits must be an int, not"
+                f" {type(fractional_bits)}: {fractional_bits!r}"
+            )
+        self.set_param("fractional_bits", fractional_bits)
+
+    @property
+    def integer_bits(self) -> int:
+        """
+        Get the number of integer bits, including the sign bit, of the fixed-point
+        format of the signal. Defaults to 1.
+        """
+        integer_bits = self.param("integer_bits")
+        return 1 if integer_bits is None else integer_bits
+
+    @integer_bits.setter
+    def integer_bits(self, integer_bits: Optional[int]) -> None:
+        """
+        Set the number of integer bits, including the sign bit, of the fixed-point
+        format of the signal. None = the default of 1.
+        """
+        if integer_bits is not None and not isinstance(integer_bits, int):
+            raise TypeError(
+                f"Integer bits must be an int, not {type(integer_bits)}:"
+                f" {integer_bits!r}"
+            )
+        self.set_param("integer_bits", integer_bits)
+
+    @property
+    def quantization(self) -> Quantization:
+        """
+        Get the quantization of the fixed-point format of the signal. Defaults to
+        :attr:`~b_asic.quantization.Quantization.TRUNCATION`.
+        """
+        quantization = self.param("quantization")
+        return Quantization.TRUNCATION if quantization is None else quantization
+
+    @quantization.setter
+    def quantization(self, quantization: Optional[Quantization]) -> None:
+        """
+        Set the quantization of the fixed-point format of the signal.
+        None = the default of truncation.
+        """
+        if quantization is not None and not isinstance(quantization, Quantization):
+            raise TypeError(
+                f"Quantization must be a Quantization, not {type(quantization)}:"
+                f" {quantization!r}"
+            )
+        self.set_param("quantization", quantization)
+
+    @property
+    def overflow(self) -> Overflow:
+        """
+        Get the overflow handling of the fixed-point format of the signal. Defaults
+        to :attr:`~b_asic.quantization.Overflow.TWOS_COMPLEMENT`.
+        """
+        overflow = self.param("overflow")
+        return Overflow.TWOS_COMPLEMENT if overflow is None else overflow
+
+    @overflow.setter
+    def overflow(self, overflow: Optional[Overflow]) -> None:
+        """
+        Set the overflow handling of the fixed-point format of the signal.
+        None = the default of two's complement.
+        """
+        if overflow is not None and not isinstance(overflow, Overflow):
+            raise TypeError(
+                f"Overflow must be an Overflow, not {type(overflow)}: {overflow!r}"
+            )
+        self.set_param("overflow", overflow)
+
     @property
     def is_constant(self) -> bool:
         """
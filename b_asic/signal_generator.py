@@ -11,15 +11,67 @@ This is handled by a number of private generator classes. Check out the source c
 if you want more information.
 """
 
-from math import pi, sin
+import random
+from math import cos, log, pi, sin, sqrt
 from numbers import Number
-from typing import List, Optional, Sequence, Union
+from typing import List, Optional, Sequence, Tuple, Union
 
 import numpy as np
 
 from b_asic.types import Num
 
 
+_PHILOX_MULTIPLIERS = (0xD2511F53, 0xCD9E8D57)
+_PHILOX_WEYL = (0x9E3779B9, 0xBB67AE85)
+_MASK32 = 0xFFFFFFFF
+_MASK64 = 0xFFFFFFFFFFFFFFFF
+
+
+def _philox4x32(
+    counter: Tuple[int, int, int, int], key: Tuple[int, int]
+) -> Tuple[int, int, int, int]:
+    """Philox4x32-10 counter-based random number generator."""
+    c0, c1, c2, c3 = counter
+    k0, k1 = key
+    for _ in range(10):
+        p0 = _PHILOX_MULTIPLIERS[0] * c0
+        p1 = _PHILOX_MULTIPLIERS[1] * c2
+        c0, c1, c2, c3 = (
+            (p1 >> 32) ^ c1 ^ k0,
+            p1 & _MASK32,
+            (p0 >> 32) ^ c3 ^ k1,
+            p0 & _MASK32,
+        )
+        k0 = (k0 + _PHILOX_WEYL[0]) & _MASK32
+        k1 = (k1 + _PHILOX_WEYL[1]) & _MASK32
+    return c0, c1, c2, c3
+
+
+def _counter_uniforms(seed: int, stream: int, time: int) -> Tuple[float, float]:
+    """
+    Two uniformly distributed values in [0, 1) that only depend on the arguments.
+
+    The native simulation engine computes the same values.
+    """
+    time &= _MASK64
+    stream &= _MASK64
+    words = _philox4x32(
+        (time & _MASK32, time >> 32, stream & _MASK32, stream >> 32),
+        (seed & _MASK32, seed >> 32),
+    )
+    first = (words[1] << 32) | words[0]
+    second = (words[3] << 32) | words[2]
+    return (first >> 11) * 2.0**-53, (second >> 11) * 2.0**-53
+
+
+def _counter_seed(seed: Optional[int]) -> int:
+    if seed is None:
+        return random.getrandbits(64)
+    if not 0 <= seed <= _MASK64:
+        raise ValueError(f"Counter-based seed must fit in 64 bits, got {seed}")
+    return seed
+
+
 class SignalGenerator:
     """
     Base class for signal generators.
@@ -232,17 +284,40 @@ class Gaussian(SignalGenerator):
         The average value of the noise.
     scale : float, default: 1.0
         The standard deviation of the noise.
+    counter_based : bool, default: False
+        If True, the value at each time only depends on *seed*, *stream* and the
+        time, using a Philox counter-based generator and the Box-Muller transform.
+        Any part of the signal can then be generated independently, in any order,
+        with the same result. Otherwise, the values are drawn in the order the
+        generator is called.
+    stream : int, default: 0
+        Selects an independent sequence for the same seed when *counter_based* is
+        True, for example the index of the input it is used for.
     """
 
     def __init__(
-        self, seed: Optional[int] = None, loc: float = 0.0, scale: float = 1.0
+        self,
+        seed: Optional[int] = None,
+        loc: float = 0.0,
+        scale: float = 1.0,
+        counter_based: bool = False,
+        stream: int = 0,
     ) -> None:
         self._rng = np.random.default_rng(seed)
         self._seed = seed
         self._loc = loc
         self._scale = scale
+        self._counter_based = counter_based
+        self._stream = stream
+        if counter_based:
+            self._key = _counter_seed(seed)
 
     def __call__(self, time: int) -> complex:
+        if self._counter_based:
+            u1, u2 = _counter_uniforms(self._key, self._stream, time)
+            # Avoid the logarithm of zero by using (0, 1] for the radius.
+            z = sqrt(-2.0 * log(1.0 - u1)) * cos(2.0 * pi * u2)
+            return self._loc + self._scale * z
         return self._rng.normal(self._loc, self._scale)
 
     def __repr__(self) -> str:
@@ -253,6 +328,10 @@ class Gaussian(SignalGenerator):
             ret_list.append(f"loc={self._loc}")
         if self._scale != 1.0:
             ret_list.append(f"scale={self._scale}")
+        if self._counter_based:
+            ret_list.append("counter_based=True")
+        if self._stream:
+            ret_list.append(f"stream={self._stream}")
         args = ", ".join(ret_list)
         return f"Gaussian({args})"
 
@@ -271,17 +350,37 @@ class Uniform(SignalGenerator):
         The lower value of the uniform range.
     high : float, default: 1.0
         The upper value of the uniform range.
+    counter_based : bool, default: False
+        If True, the value at each time only depends on *seed*, *stream* and the
+        time, using a Philox counter-based generator. Any part of the signal can
+        then be generated independently, in any order, with the same result.
+        Otherwise, the values are drawn in the order the generator is called.
+    stream : int, default: 0
+        Selects an independent sequence for the same seed when *counter_based* is
+        True, for example the index of the input it is used for.
     """
 
     def __init__(
-        self, seed: Optional[int] = None, low: float = -1.0, high: float = 1.0
+        self,
+        seed: Optional[int] = None,
+        low: float = -1.0,
+        high: float = 1.0,
+        counter_based: bool = False,
+        stream: int = 0,
     ) -> None:
         self._rng = np.random.default_rng(seed)
         self._seed = seed
         self._low = low
         self._high = high
+        self._counter_based = counter_based
+        self._stream = stream
+        if counter_based:
+            self._key = _counter_seed(seed)
 
     def __call__(self, time: int) -> complex:
+        if self._counter_based:
+            u, _ = _counter_uniforms(self._key, self._stream, time)
+            return self._low + (self._high - self._low) * u
         return self._rng.uniform(self._low, self._high)
 
     def __repr__(self) -> str:
@@ -292,6 +391,10 @@ class Uniform(SignalGenerator):
             ret_list.append(f"low={self._low}")
         if self._high != 1.0:
             ret_list.append(f"high={self._high}")
+        if self._counter_based:
+            ret_list.append("counter_based=True")
+        if self._stream:
+            ret_list.append(f"stream={self._stream}")
         args = ", ".join(ret_list)
         return f"Uniform({args})"
 
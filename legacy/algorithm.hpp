@@ -0,0 +1,241 @@
+#ifndef ASIC_ALGORITHM_HPP
+#define ASIC_ALGORITHM_HPP
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace asic {
+
+namespace detail {
+
+template <typename Reference>
+struct arrow_proxy final {
+	Reference value;
+
+	[[nodiscard]] constexpr Reference* operator->() noexcept {
+		return std::addressof(value);
+	}
+};
+
+template <typename T>
+struct range_view final {
+	class iterator final {
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = T;
+		using reference = T;
+		using pointer = void;
+		using iterator_category = std::forward_iterator_tag;
+
+		constexpr iterator() noexcept = default;
+
+		constexpr explicit iterator(T value) noexcept
+			: m_value(value) {}
+
+		[[nodiscard]] constexpr T operator*() const noexcept {
+			return m_value;
+		}
+
+		constexpr iterator& operator++() noexcept {
+			++m_value;
+			return *this;
+		}
+
+		constexpr iterator operator++(int) noexcept {
+			auto const copy = *this;
+			++(*this);
+			return copy;
+		}
+
+		[[nodiscard]] constexpr bool operator==(iterator const& other) const noexcept {
+			return m_value == other.m_value;
+		}
+
+		[[nodiscard]] constexpr bool operator!=(iterator const& other) const noexcept {
+			return m_value != other.m_value;
+		}
+
+	private:
+		T m_value{};
+	};
+
+	using sentinel = iterator;
+
+	iterator first;
+	sentinel last;
+
+	[[nodiscard]] constexpr iterator begin() const noexcept {
+		return first;
+	}
+
+	[[nodiscard]] constexpr sentinel end() const noexcept {
+		return last;
+	}
+};
+
+template <typename Range>
+struct enumerate_view final {
+	using underlying_iterator = decltype(std::begin(std::declval<Range&>()));
+	using underlying_sentinel = decltype(std::end(std::declval<Range&>()));
+
+	class iterator final {
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::tuple<std::size_t, typename std::iterator_traits<underlying_iterator>::reference>;
+		using reference = value_type;
+		using pointer = void;
+		using iterator_category = std::forward_iterator_tag;
+
+		constexpr iterator() = default;
+
+		constexpr explicit iterator(underlying_iterator it)
+			: m_it(std::move(it)) {}
+
+		[[nodiscard]] constexpr reference operator*() const {
+			return reference{m_index, *m_it};
+		}
+
+		[[nodiscard]] constexpr arrow_proxy<reference> operator->() const {
+			return arrow_proxy<reference>{**this};
+		}
+
+		constexpr iterator& operator++() {
+			++m_it;
+			++m_index;
+			return *this;
+		}
+
+		constexpr iterator operator++(int) {
+			auto copy = *this;
+			++(*this);
+			return copy;
+		}
+
+		[[nodiscard]] constexpr bool operator==(iterator const& other) const {
+			return m_it == other.m_it;
+		}
+
+		[[nodiscard]] constexpr bool operator!=(iterator const& other) const {
+			return m_it != other.m_it;
+		}
+
+	private:
+		underlying_iterator m_it;
+		std::size_t m_index = 0;
+	};
+
+	Range range;
+
+	[[nodiscard]] constexpr iterator begin() {
+		return iterator{std::begin(range)};
+	}
+
+	[[nodiscard]] constexpr iterator end() {
+		return iterator{std::end(range)};
+	}
+};
+
+template <typename... Ranges>
+struct zip_view final {
+	using underlying_iterators = std::tuple<decltype(std::begin(std::declval<Ranges&>()))...>;
+
+	class iterator final {
+	public:
+		using difference_type = std::ptrdiff_t;
+		using value_type = std::tuple<typename std::iterator_traits<decltype(std::begin(std::declval<Ranges&>()))>::reference...>;
+		using reference = value_type;
+		using pointer = void;
+		using iterator_category = std::forward_iterator_tag;
+
+		constexpr iterator() = default;
+
+		constexpr explicit iterator(underlying_iterators its)
+			: m_its(std::move(its)) {}
+
+		[[nodiscard]] constexpr reference operator*() const {
+			return std::apply([](auto&... its) { return reference{*its...}; }, m_its);
+		}
+
+		[[nodiscard]] constexpr arrow_proxy<reference> operator->() const {
+			return arrow_proxy<reference>{**this};
+		}
+
+		constexpr iterator& operator++() {
+			std::apply([](auto&... its) { (++its, ...); }, m_its);
+			return *this;
+		}
+
+		constexpr iterator operator++(int) {
+			auto copy = *this;
+			++(*this);
+			return copy;
+		}
+
+		// Iteration stops at the end of the shortest range.
+		[[nodiscard]] constexpr bool operator==(iterator const& other) const {
+			return this->any_equal(other, std::index_sequence_for<Ranges...>{});
+		}
+
+		[[nodiscard]] constexpr bool operator!=(iterator const& other) const {
+			return !(*this == other);
+		}
+
+	private:
+		template <std::size_t... Indices>
+		[[nodiscard]] constexpr bool any_equal(iterator const& other, std::index_sequence<Indices...>) const {
+			return ((std::get<Indices>(m_its) == std::get<Indices>(other.m_its)) || ...);
+		}
+
+		underlying_iterators m_its;
+	};
+
+	std::tuple<Ranges...> ranges;
+
+	[[nodiscard]] constexpr iterator begin() {
+		return iterator{std::apply([](auto&... rs) { return underlying_iterators{std::begin(rs)...}; }, ranges)};
+	}
+
+	[[nodiscard]] constexpr iterator end() {
+		return iterator{std::apply([](auto&... rs) { return underlying_iterators{std::end(rs)...}; }, ranges)};
+	}
+};
+
+} // namespace detail
+
+// Iterate over the integers in [first, last).
+template <typename First, typename Last>
+[[nodiscard]] constexpr auto range(First first, Last last) {
+	using T = std::common_type_t<First, Last>;
+	if (static_cast<T>(last) < static_cast<T>(first)) {
+		last = static_cast<Last>(first);
+	}
+	return detail::range_view<T>{typename detail::range_view<T>::iterator{static_cast<T>(first)},
+								 typename detail::range_view<T>::iterator{static_cast<T>(last)}};
+}
+
+// Iterate over the integers in [0, last).
+template <typename Last>
+[[nodiscard]] constexpr auto range(Last last) {
+	return range(Last{}, last);
+}
+
+// Iterate over the elements of a range together with their indices, as tuples of an index and a reference. Temporary ranges are
+// kept alive by the view.
+template <typename Range>
+[[nodiscard]] constexpr auto enumerate(Range&& range) {
+	return detail::enumerate_view<Range>{std::forward<Range>(range)};
+}
+
+// Iterate over several ranges in lockstep, as tuples of references, until the shortest one ends.
+template <typename... Ranges>
+[[nodiscard]] constexpr auto zip(Ranges&&... ranges) {
+	return detail::zip_view<Ranges...>{std::tuple<Ranges...>{std::forward<Ranges>(ranges)...}};
+}
+
+} // namespace asic
+
+#endif // ASIC_ALGORITHM_HPP
@@ -0,0 +1,86 @@
+#ifndef ASIC_DEBUG_HPP
+#define ASIC_DEBUG_HPP
+
+// Debug messages are written to debug_log_filename in the working directory when ASIC_ENABLE_DEBUG_LOGGING is set to 1, and
+// assertions are checked unless NDEBUG is defined or ASIC_ENABLE_ASSERTS is set to 0.
+#ifndef ASIC_ENABLE_DEBUG_LOGGING
+#define ASIC_ENABLE_DEBUG_LOGGING 0
+#endif
+
+#ifndef ASIC_ENABLE_ASSERTS
+#ifdef NDEBUG
+#define ASIC_ENABLE_ASSERTS 0
+#else
+#define ASIC_ENABLE_ASSERTS 1
+#endif
+#endif
+
+#if ASIC_ENABLE_DEBUG_LOGGING || ASIC_ENABLE_ASSERTS
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <utility>
+#endif
+
+namespace asic {
+
+constexpr auto debug_log_filename = "_b_asic_debug_log.txt";
+
+namespace detail {
+
+#if ASIC_ENABLE_DEBUG_LOGGING || ASIC_ENABLE_ASSERTS
+[[nodiscard]] inline std::string debug_location(std::string_view file, int line) {
+	return fmt::format("{}:{}", std::filesystem::path{file}.filename().generic_string(), line);
+}
+#endif
+
+#if ASIC_ENABLE_DEBUG_LOGGING
+inline void log_debug_msg_string(std::string_view file, int line, std::string_view string) {
+	static auto log_file = std::ofstream{debug_log_filename, std::ios::trunc};
+	log_file << fmt::format("{:<40}: {}", debug_location(file, line), string) << std::endl;
+}
+
+template <typename Format, typename... Args>
+inline void log_debug_msg(std::string_view file, int line, Format&& format, Args&&... args) {
+	log_debug_msg_string(file, line, fmt::format(std::forward<Format>(format), std::forward<Args>(args)...));
+}
+#endif
+
+#if ASIC_ENABLE_ASSERTS
+[[noreturn]] inline void fail_assert(std::string_view file, int line, std::string_view condition_string) {
+#if ASIC_ENABLE_DEBUG_LOGGING
+	log_debug_msg_string(file, line, fmt::format("Assertion failed: {}", condition_string));
+#endif
+	fmt::print(stderr, "{}: Assertion failed: {}\n", debug_location(file, line), condition_string);
+	std::abort();
+}
+
+template <typename BoolConvertible>
+inline void check_assert(std::string_view file, int line, std::string_view condition_string, BoolConvertible&& condition) {
+	if (!static_cast<bool>(std::forward<BoolConvertible>(condition))) {
+		fail_assert(file, line, condition_string);
+	}
+}
+#endif
+
+} // namespace detail
+
+} // namespace asic
+
+#if ASIC_ENABLE_DEBUG_LOGGING
+#define ASIC_DEBUG_MSG(...) (asic::detail::log_debug_msg(__FILE__, __LINE__, __VA_ARGS__))
+#else
+#define ASIC_DEBUG_MSG(...) ((void)0)
+#endif
+
+#if ASIC_ENABLE_ASSERTS
+#define ASIC_ASSERT(condition) (asic::detail::check_assert(__FILE__, __LINE__, #condition, (condition)))
+#else
+#define ASIC_ASSERT(condition) (static_cast<void>(sizeof(static_cast<bool>(condition))))
+#endif
+
+#endif // ASIC_DEBUG_HPP
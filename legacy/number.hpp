@@ -0,0 +1,14 @@
+#ifndef ASIC_NUMBER_HPP
+#define ASIC_NUMBER_HPP
+
+#include <complex>
+#include <pybind11/complex.h>
+
+namespace asic {
+
+// Values of signals, which are converted to and from Python complex numbers.
+using number = std::complex<double>;
+
+} // namespace asic
+
+#endif // ASIC_NUMBER_HPP
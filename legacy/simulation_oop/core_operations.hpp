@@ -5,10 +5,9 @@
 #include "../number.hpp"
 #include "operation.hpp"
 
-#include <algorithm>
 #include <cmath>
 #include <cstddef>
-#include <stdexcept>
+#include <cstdint>
 #include <utility>
 
 namespace asic {
@@ -24,9 +23,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const&) const final {
-		ASIC_DEBUG_MSG("Evaluating constant.");
-		return m_value;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling constant.");
+		auto const index = static_cast<std::uint32_t>(context.code->constants.size());
+		context.code->constants.push_back(m_value);
+		return context.code->emit(opcode::constant, {no_slot, no_slot, no_slot}, index);
 	}
 
 	number m_value;
@@ -42,9 +43,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating addition.");
-		return this->evaluate_lhs(context) + this->evaluate_rhs(context);
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling addition.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::addition, {lhs, rhs, no_slot});
 	}
 };
 
@@ -58,12 +61,35 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating subtraction.");
-		return this->evaluate_lhs(context) - this->evaluate_rhs(context);
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling subtraction.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::subtraction, {lhs, rhs, no_slot});
 	}
 };
 
+class addition_subtraction_operation final : public binary_operation {
+public:
+	addition_subtraction_operation(result_key key, bool is_add)
+		: binary_operation(std::move(key))
+		, m_is_add(is_add) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 1;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling addsub.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit((m_is_add) ? opcode::addition : opcode::subtraction, {lhs, rhs, no_slot});
+	}
+
+	bool m_is_add;
+};
+
 class multiplication_operation final : public binary_operation {
 public:
 	explicit multiplication_operation(result_key key)
@@ -74,9 +100,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating multiplication.");
-		return this->evaluate_lhs(context) * this->evaluate_rhs(context);
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling multiplication.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::multiplication, {lhs, rhs, no_slot});
 	}
 };
 
@@ -90,9 +118,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating division.");
-		return this->evaluate_lhs(context) / this->evaluate_rhs(context);
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling division.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::division, {lhs, rhs, no_slot});
 	}
 };
 
@@ -106,17 +136,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating min.");
-		auto const lhs = this->evaluate_lhs(context);
-		if (lhs.imag() != 0) {
-			throw std::runtime_error{"Min does not support complex numbers."};
-		}
-		auto const rhs = this->evaluate_rhs(context);
-		if (rhs.imag() != 0) {
-			throw std::runtime_error{"Min does not support complex numbers."};
-		}
-		return std::min(lhs.real(), rhs.real());
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling min.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::min, {lhs, rhs, no_slot});
 	}
 };
 
@@ -130,17 +154,11 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating max.");
-		auto const lhs = this->evaluate_lhs(context);
-		if (lhs.imag() != 0) {
-			throw std::runtime_error{"Max does not support complex numbers."};
-		}
-		auto const rhs = this->evaluate_rhs(context);
-		if (rhs.imag() != 0) {
-			throw std::runtime_error{"Max does not support complex numbers."};
-		}
-		return std::max(lhs.real(), rhs.real());
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling max.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit(opcode::max, {lhs, rhs, no_slot});
 	}
 };
 
@@ -154,9 +172,10 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating sqrt.");
-		return std::sqrt(this->evaluate_input(context));
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling sqrt.");
+		auto const in = this->compile_input(context);
+		return context.code->emit(opcode::square_root, {in, no_slot, no_slot});
 	}
 };
 
@@ -170,9 +189,10 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating conj.");
-		return std::conj(this->evaluate_input(context));
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling conj.");
+		auto const in = this->compile_input(context);
+		return context.code->emit(opcode::complex_conjugate, {in, no_slot, no_slot});
 	}
 };
 
@@ -186,9 +206,10 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating abs.");
-		return std::abs(this->evaluate_input(context));
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling abs.");
+		auto const in = this->compile_input(context);
+		return context.code->emit(opcode::absolute, {in, no_slot, no_slot});
 	}
 };
 
@@ -203,9 +224,12 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating cmul.");
-		return this->evaluate_input(context) * m_value;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling cmul.");
+		auto const in = this->compile_input(context);
+		auto const index = static_cast<std::uint32_t>(context.code->constants.size());
+		context.code->constants.push_back(m_value);
+		return context.code->emit(opcode::constant_multiplication, {in, no_slot, no_slot}, index);
 	}
 
 	number m_value;
@@ -221,12 +245,107 @@ public:
 	}
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final {
-		ASIC_DEBUG_MSG("Evaluating bfly.");
-		if (index == 0) {
-			return this->evaluate_lhs(context) + this->evaluate_rhs(context);
-		}
-		return this->evaluate_lhs(context) - this->evaluate_rhs(context);
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling bfly.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		return context.code->emit((index == 0) ? opcode::addition : opcode::subtraction, {lhs, rhs, no_slot});
+	}
+};
+
+class multiply_add_operation final : public nary_operation {
+public:
+	explicit multiply_add_operation(result_key key)
+		: nary_operation(std::move(key)) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 1;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling mad.");
+		ASIC_ASSERT(this->inputs().size() == 3);
+		auto const in = this->compile_inputs(context);
+		return context.code->emit(opcode::multiply_add, {in[0], in[1], in[2]});
+	}
+};
+
+class symmetric_twoport_adaptor_operation final : public binary_operation {
+public:
+	symmetric_twoport_adaptor_operation(result_key key, number value)
+		: binary_operation(std::move(key))
+		, m_value(value) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 2;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling sym2p.");
+		auto const lhs = this->compile_lhs(context);
+		auto const rhs = this->compile_rhs(context);
+		auto const constant = static_cast<std::uint32_t>(context.code->constants.size());
+		context.code->constants.push_back(m_value);
+		return context.code->emit(opcode::symmetric_twoport_adaptor, {lhs, rhs, (index == 0) ? rhs : lhs}, constant);
+	}
+
+	number m_value;
+};
+
+class reciprocal_operation final : public unary_operation {
+public:
+	explicit reciprocal_operation(result_key key)
+		: unary_operation(std::move(key)) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 1;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling rec.");
+		auto const in = this->compile_input(context);
+		return context.code->emit(opcode::reciprocal, {in, no_slot, no_slot});
+	}
+};
+
+class shift_operation final : public unary_operation {
+public:
+	shift_operation(result_key key, int value)
+		: unary_operation(std::move(key))
+		, m_value(value) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 1;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const& context) const final {
+		ASIC_DEBUG_MSG("Compiling shift.");
+		auto const in = this->compile_input(context);
+		auto const index = static_cast<std::uint32_t>(context.code->constants.size());
+		// Multiplying by an exact power of two gives the same result as shifting.
+		context.code->constants.push_back(std::ldexp(1.0, m_value));
+		return context.code->emit(opcode::constant_multiplication, {in, no_slot, no_slot}, index);
+	}
+
+	int m_value;
+};
+
+class sink_operation final : public unary_operation {
+public:
+	explicit sink_operation(result_key key)
+		: unary_operation(std::move(key)) {}
+
+	[[nodiscard]] std::size_t output_count() const noexcept final {
+		return 0;
+	}
+
+private:
+	[[nodiscard]] slot_index compile_output_impl(std::size_t, compilation_context const&) const final {
+		return no_slot;
 	}
 };
 
@@ -5,10 +5,11 @@
 
 namespace asic {
 
-custom_operation::custom_operation(result_key key, pybind11::object evaluate_output, pybind11::object quantize_input,
-								   std::size_t output_count)
+custom_operation::custom_operation(result_key key, pybind11::object evaluate_output, pybind11::object evaluate_output_block,
+								   pybind11::object quantize_input, std::size_t output_count)
 	: nary_operation(std::move(key))
 	, m_evaluate_output(std::move(evaluate_output))
+	, m_evaluate_output_block(std::move(evaluate_output_block))
 	, m_quantize_input(std::move(quantize_input))
 	, m_output_count(output_count) {}
 
@@ -16,14 +17,43 @@ std::size_t custom_operation::output_count() const noexcept {
 	return m_output_count;
 }
 
-number custom_operation::evaluate_output_impl(std::size_t index, evaluation_context const& context) const {
+bool custom_operation::has_block_evaluation() const noexcept {
+	return !m_evaluate_output_block.is_none();
+}
+
+number custom_operation::evaluate(std::size_t index, std::vector<number> input_values) const {
 	using namespace pybind11::literals;
-	auto input_values = this->evaluate_inputs(context);
 	return m_evaluate_output(index, std::move(input_values), "quantize"_a = false).cast<number>();
 }
 
-number custom_operation::quantize_input(std::size_t index, number value, std::size_t bits) const {
+number_array custom_operation::evaluate_block(std::size_t index, pybind11::array_t<number> input_values) const {
+	using namespace pybind11::literals;
+	ASIC_ASSERT(this->has_block_evaluation());
+	auto const sample_count = input_values.shape(1);
+	auto output_values = number_array::ensure(m_evaluate_output_block(index, std::move(input_values), "quantize"_a = false));
+	if (!output_values || output_values.ndim() != 1 || output_values.shape(0) != sample_count) {
+		throw pybind11::value_error{
+			fmt::format("Block evaluation of operation \"{}\" must return one value per sample (expected {})", this->key_base(), sample_count)};
+	}
+	return output_values;
+}
+
+number custom_operation::quantize(std::size_t index, number value, std::size_t bits) const {
 	return m_quantize_input(index, value, bits).cast<number>();
 }
 
+slot_index custom_operation::compile_output_impl(std::size_t index, compilation_context const& context) const {
+	auto inputs = this->compile_inputs(context);
+	auto const call = static_cast<std::uint32_t>(context.code->custom_calls.size());
+	context.code->custom_calls.push_back(custom_call{this, index, std::move(inputs)});
+	return context.code->emit(opcode::custom, {no_slot, no_slot, no_slot}, call);
+}
+
+slot_index custom_operation::quantize_input(std::size_t index, slot_index value, std::size_t bits,
+											compilation_context const& context) const {
+	auto const call = static_cast<std::uint32_t>(context.code->custom_calls.size());
+	context.code->custom_calls.push_back(custom_call{this, index, {}});
+	return context.code->emit(opcode::custom_quantize, {value, no_slot, no_slot}, call, static_cast<std::uint32_t>(bits));
+}
+
 } // namespace asic
@@ -10,23 +10,35 @@
 #include <cstddef>
 #include <fmt/format.h>
 #include <functional>
+#include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <stdexcept>
 #include <utility>
+#include <vector>
 
 namespace asic {
 
+using number_array = pybind11::array_t<number, pybind11::array::c_style | pybind11::array::forcecast>;
+
 class custom_operation final : public nary_operation {
 public:
-	custom_operation(result_key key, pybind11::object evaluate_output, pybind11::object quantize_input, std::size_t output_count);
+	custom_operation(result_key key, pybind11::object evaluate_output, pybind11::object evaluate_output_block, pybind11::object quantize_input,
+					 std::size_t output_count);
 
 	[[nodiscard]] std::size_t output_count() const noexcept final;
+	[[nodiscard]] bool has_block_evaluation() const noexcept;
+
+	[[nodiscard]] number evaluate(std::size_t index, std::vector<number> input_values) const;
+	[[nodiscard]] number_array evaluate_block(std::size_t index, pybind11::array_t<number> input_values) const;
+	[[nodiscard]] number quantize(std::size_t index, number value, std::size_t bits) const;
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final;
-	[[nodiscard]] number quantize_input(std::size_t index, number value, std::size_t bits) const final;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final;
+	[[nodiscard]] slot_index quantize_input(std::size_t index, slot_index value, std::size_t bits,
+											compilation_context const& context) const final;
 
 	pybind11::object m_evaluate_output;
+	pybind11::object m_evaluate_output_block;
 	pybind11::object m_quantize_input;
 	std::size_t m_output_count;
 };
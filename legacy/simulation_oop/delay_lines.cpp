@@ -0,0 +1,104 @@
+#include "delay_lines.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace asic {
+
+namespace {
+
+constexpr auto no_instruction = std::numeric_limits<std::size_t>::max();
+
+} // namespace
+
+void collapse_delay_chains(program& code) {
+	ASIC_ASSERT(code.delay_lines.empty());
+	auto producers = std::vector<std::size_t>(code.slot_count, no_instruction);
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.type == opcode::delay) {
+			producers[instruction.result] = i;
+		}
+	}
+	// A delay whose output feeds several delays continues only into the first of them. The others start chains of their own.
+	auto next = std::vector<std::size_t>(code.instructions.size(), no_instruction);
+	auto continued = std::vector<bool>(code.instructions.size(), false);
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.type != opcode::delay || instruction.operands[0] == no_slot) {
+			continue;
+		}
+		if (auto const previous = producers[instruction.operands[0]]; previous != no_instruction && next[previous] == no_instruction) {
+			next[previous] = i;
+			continued[i] = true;
+		}
+	}
+
+	auto removed = std::vector<bool>(code.instructions.size(), false);
+	auto collapsed = std::vector<bool>(code.delays.size(), false);
+	auto chains = std::vector<std::vector<std::size_t>>{};
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		// Delays that only feed each other in a loop have no first delay, and are left as they are.
+		if (instruction.type != opcode::delay || continued[i] || next[i] == no_instruction) {
+			continue;
+		}
+		auto& chain = chains.emplace_back();
+		for (auto delay = i; delay != no_instruction; delay = next[delay]) {
+			chain.push_back(delay);
+			removed[delay] = true;
+			collapsed[code.instructions[delay].index] = true;
+		}
+	}
+	if (chains.empty()) {
+		return;
+	}
+
+	// The registers of each line are stored together, from the last delay of the chain to the first.
+	auto registers = std::vector<std::uint32_t>(code.delays.size());
+	auto delays = std::vector<delay_register>{};
+	delays.reserve(code.delays.size());
+	for (auto&& [i, reg] : enumerate(code.delays)) {
+		if (!collapsed[i]) {
+			registers[i] = static_cast<std::uint32_t>(delays.size());
+			delays.push_back(std::move(reg));
+		}
+	}
+	for (auto const& chain : chains) {
+		auto& line = code.delay_lines.emplace_back();
+		line.source = code.instructions[chain.front()].operands[0];
+		line.first_register = static_cast<std::uint32_t>(delays.size());
+		for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+			auto const reg = code.instructions[*it].index;
+			registers[reg] = static_cast<std::uint32_t>(delays.size());
+			delays.push_back(std::move(code.delays[reg]));
+		}
+		for (auto const delay : chain) {
+			line.taps.push_back(code.instructions[delay].result);
+		}
+	}
+
+	auto instructions = std::vector<instruction>{};
+	instructions.reserve(code.instructions.size());
+	for (auto&& [i, instruction] : enumerate(code.instructions)) {
+		auto const is_delay = instruction.type == opcode::delay || instruction.type == opcode::store_delay;
+		if (removed[i] || (instruction.type == opcode::store_delay && collapsed[instruction.index])) {
+			continue;
+		}
+		if (is_delay) {
+			instruction.index = registers[instruction.index];
+		}
+		instructions.push_back(instruction);
+	}
+	// Like the delay registers, each line takes the value of its source after it has been evaluated.
+	for (auto&& [i, line] : enumerate(code.delay_lines)) {
+		instructions.push_back(instruction{opcode::delay_line, no_slot, {line.source, no_slot, no_slot}, static_cast<std::uint32_t>(i)});
+	}
+	code.instructions = std::move(instructions);
+	code.delays = std::move(delays);
+}
+
+} // namespace asic
@@ -0,0 +1,15 @@
+#ifndef ASIC_SIMULATION_DELAY_LINES_HPP
+#define ASIC_SIMULATION_DELAY_LINES_HPP
+
+#include "instruction.hpp"
+
+namespace asic {
+
+// Replace each chain of two or more delays, where every delay but the first takes the output of the previous one as its input,
+// by a delay line. Each block then copies the source once into the line instead of shifting it through every delay. Must run
+// before scheduling.
+void collapse_delay_chains(program& code);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_DELAY_LINES_HPP
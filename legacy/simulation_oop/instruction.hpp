@@ -0,0 +1,134 @@
+#ifndef ASIC_SIMULATION_INSTRUCTION_HPP
+#define ASIC_SIMULATION_INSTRUCTION_HPP
+
+#include "../number.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace asic {
+
+class custom_operation;
+
+using result_key = std::string;
+using slot_index = std::uint32_t;
+
+constexpr auto no_slot = std::numeric_limits<slot_index>::max();
+constexpr auto max_fixed_point_word_length = 62;
+
+enum class opcode : std::uint8_t {
+	constant,
+	delay,
+	store_delay,
+	delay_line,
+	quantize,
+	fixed_point_quantize,
+	custom_quantize,
+	addition,
+	subtraction,
+	multiplication,
+	division,
+	min,
+	max,
+	square_root,
+	complex_conjugate,
+	absolute,
+	constant_multiplication,
+	multiply_add,
+	symmetric_twoport_adaptor,
+	reciprocal,
+	custom,
+};
+
+struct instruction final {
+	opcode type = opcode::constant;
+	slot_index result = no_slot;
+	std::array<slot_index, 3> operands{no_slot, no_slot, no_slot};
+	std::uint32_t index = 0; // Constant, delay register, delay line, custom call, format or input index, depending on the type.
+	std::uint32_t bits = 0;
+};
+
+// The values match the Quantization and Overflow enumerations in b_asic.quantization.
+enum class quantization_mode : std::uint8_t {
+	rounding = 1,
+	truncation = 2,
+	magnitude_truncation = 3,
+	jamming = 4,
+	unbiased_rounding = 5,
+	unbiased_jamming = 6,
+};
+
+enum class overflow_mode : std::uint8_t {
+	twos_complement = 1,
+	saturation = 2,
+};
+
+struct fixed_point_format final {
+	int integer_bits = 1;
+	int fractional_bits = 0;
+	quantization_mode quantization = quantization_mode::truncation;
+	overflow_mode overflow = overflow_mode::twos_complement;
+};
+
+struct segment final {
+	std::size_t begin = 0;
+	std::size_t end = 0;
+	bool recurrent = false; // Evaluated one sample at a time because it contains feedback through delays.
+};
+
+struct delay_register final {
+	result_key key;
+	number initial_value;
+};
+
+// A chain of delays stored as one buffer holding the previous values of the source followed by the current block, in which the
+// output of the k:th delay is the view starting k iterations before the block. taps[k] is the slot of the (k + 1):th delay, and
+// the registers starting at first_register hold the previous values, oldest first.
+struct delay_line final {
+	slot_index source = no_slot;
+	std::uint32_t first_register = 0;
+	std::vector<slot_index> taps{};
+};
+
+struct custom_call final {
+	custom_operation const* op = nullptr;
+	std::size_t index = 0;
+	std::vector<slot_index> inputs{};
+};
+
+struct program final {
+	[[nodiscard]] slot_index allocate_slot() noexcept {
+		return static_cast<slot_index>(slot_count++);
+	}
+
+	slot_index emit(opcode type, std::array<slot_index, 3> operands = {no_slot, no_slot, no_slot}, std::uint32_t index = 0,
+					std::uint32_t bits = 0) {
+		auto const result = this->allocate_slot();
+		instructions.push_back(instruction{type, result, operands, index, bits});
+		return result;
+	}
+
+	std::vector<instruction> instructions{};
+	std::vector<segment> segments{};
+	std::vector<number> constants{};
+	std::vector<delay_register> delays{};
+	std::vector<delay_line> delay_lines{};
+	std::vector<fixed_point_format> formats{};
+	std::vector<custom_call> custom_calls{};
+	std::vector<result_key> result_keys{};
+	std::vector<slot_index> result_slots{};
+	std::vector<slot_index> input_slots{};
+	std::vector<slot_index> output_slots{};
+	std::size_t slot_count = 0;
+	std::vector<std::size_t> slot_offsets{}; // Where each slot starts in the values, as assigned by layout_values.
+	std::size_t value_count = 0;
+};
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_INSTRUCTION_HPP
@@ -0,0 +1,408 @@
+#include "kernel.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+
+#include <array>
+#include <cerrno>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fmt/format.h>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#ifndef _WIN32
+#include <dlfcn.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ; // NOLINT(readability-redundant-declaration)
+#endif
+
+namespace asic {
+
+namespace {
+
+static_assert(std::is_same_v<real_number, double>, "Kernels are generated for double samples.");
+
+// Matches quantize_fixed_point in run.cpp, but reports values that are not finite by returning false.
+constexpr auto kernel_prelude = std::string_view{R"(#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+namespace {
+
+bool quantize(double value, int integer_bits, int fractional_bits, int quantization, int overflow, double& quantized) {
+	auto const scaled = std::ldexp(value, fractional_bits);
+	auto rounded = 0.0;
+	auto jam = false;
+	switch (quantization) {
+		case 1: rounded = std::floor(scaled + 0.5); break;
+		case 2: rounded = std::floor(scaled); break;
+		case 3: rounded = std::trunc(scaled); break;
+		case 4: rounded = std::floor(scaled); jam = true; break;
+		case 5: rounded = std::nearbyint(scaled); break;
+		case 6: rounded = std::floor(scaled); jam = rounded != scaled; break;
+	}
+	if (!std::isfinite(rounded)) {
+		return false;
+	}
+	auto const limit = std::int64_t{1} << (integer_bits + fractional_bits - 1);
+	auto result = std::int64_t{};
+	if (overflow == 2) {
+		result = static_cast<std::int64_t>(std::clamp(rounded, -static_cast<double>(limit) - 2, static_cast<double>(limit) + 1));
+		if (jam) {
+			result |= 1;
+		}
+		result = std::clamp(result, -limit, limit - 1);
+	} else {
+		result = static_cast<std::int64_t>(std::fmod(rounded, static_cast<double>(2 * limit)));
+		if (jam) {
+			result |= 1;
+		}
+		result = (result + limit) % (2 * limit);
+		if (result < 0) {
+			result += 2 * limit;
+		}
+		result -= limit;
+	}
+	quantized = std::ldexp(static_cast<double>(result), -fractional_bits);
+	return true;
+}
+
+} // namespace
+
+)"};
+
+constexpr auto kernel_symbol = "asic_kernel";
+
+// Exact, so that the kernel computes with the same constants as run_program.
+[[nodiscard]] std::string literal(real_number value) {
+	if (std::isnan(value)) {
+		return "std::numeric_limits<double>::quiet_NaN()";
+	}
+	if (std::isinf(value)) {
+		return (value < 0) ? "(-std::numeric_limits<double>::infinity())" : "std::numeric_limits<double>::infinity()";
+	}
+	return fmt::format("({:a})", value);
+}
+
+void generate_instruction(std::string& source, program const& code, instruction const& instruction, std::size_t lanes,
+						  std::string_view begin, std::string_view end) {
+	auto out = std::back_inserter(source);
+	auto const offset = [&](slot_index slot) {
+		return code.slot_offsets[slot];
+	};
+	auto const value = [&](slot_index slot) {
+		return fmt::format("v[{} + n]", offset(slot));
+	};
+	auto const loop = [&](std::string_view expression) {
+		fmt::format_to(out, "\tfor (std::size_t n = {}; n < {}; ++n) {{\n\t\tv[{} + n] = {};\n\t}}\n", begin, end,
+					   offset(instruction.result), expression);
+	};
+	auto const [a, b, c] = instruction.operands;
+	switch (instruction.type) {
+		case opcode::constant:
+			loop(literal(code.constants[instruction.index].real()));
+			break;
+		case opcode::delay:
+			loop(fmt::format("(n < {}) ? d[{} + n] : v[{} + n - {}]", lanes, instruction.index * lanes, offset(a), lanes));
+			break;
+		case opcode::store_delay:
+			fmt::format_to(out, "\tstd::copy(v + {} + ({}) - {}, v + {} + ({}), d + {});\n", offset(a), end, lanes, offset(a), end,
+						   instruction.index * lanes);
+			break;
+		case opcode::delay_line:
+			fmt::format_to(out, "\tstd::copy(v + {} + ({}), v + {} + ({}), v + {} + ({}));\n", offset(a), begin, offset(a), end,
+						   offset(code.delay_lines[instruction.index].taps.front()) + lanes, begin);
+			break;
+		case opcode::quantize:
+			loop(fmt::format("static_cast<double>(static_cast<std::int64_t>({}) & ((std::int64_t{{1}} << {}) - 1))", value(a),
+							 instruction.bits));
+			break;
+		case opcode::fixed_point_quantize: {
+			auto const& format = code.formats[instruction.index];
+			fmt::format_to(out, "\tfor (std::size_t n = {}; n < {}; ++n) {{\n\t\tif (!quantize({}, {}, {}, {}, {}, v[{} + n])) {{\n"
+								"\t\t\treturn 1;\n\t\t}}\n\t}}\n",
+						   begin, end, value(a), format.integer_bits, format.fractional_bits, static_cast<int>(format.quantization),
+						   static_cast<int>(format.overflow), offset(instruction.result));
+			break;
+		}
+		case opcode::addition:
+			loop(fmt::format("{} + {}", value(a), value(b)));
+			break;
+		case opcode::subtraction:
+			loop(fmt::format("{} - {}", value(a), value(b)));
+			break;
+		case opcode::multiplication:
+			loop(fmt::format("{} * {}", value(a), value(b)));
+			break;
+		case opcode::division:
+			loop(fmt::format("{} / {}", value(a), value(b)));
+			break;
+		case opcode::min:
+			loop(fmt::format("std::min({}, {})", value(a), value(b)));
+			break;
+		case opcode::max:
+			loop(fmt::format("std::max({}, {})", value(a), value(b)));
+			break;
+		case opcode::square_root:
+			loop(fmt::format("std::sqrt({})", value(a)));
+			break;
+		case opcode::complex_conjugate:
+			loop(value(a));
+			break;
+		case opcode::absolute:
+			loop(fmt::format("std::abs({})", value(a)));
+			break;
+		case opcode::constant_multiplication:
+			loop(fmt::format("{} * {}", value(a), literal(code.constants[instruction.index].real())));
+			break;
+		case opcode::multiply_add:
+			loop(fmt::format("{} * {} + {}", value(a), value(b), value(c)));
+			break;
+		case opcode::symmetric_twoport_adaptor:
+			loop(fmt::format("{} + {} * ({} - {})", value(c), literal(code.constants[instruction.index].real()), value(b), value(a)));
+			break;
+		case opcode::reciprocal:
+			loop(fmt::format("1.0 / {}", value(a)));
+			break;
+		case opcode::custom_quantize:
+		case opcode::custom:
+			ASIC_ASSERT(false);
+			break;
+	}
+}
+
+// FNV-1a, which unlike std::hash gives the same names in every process.
+[[nodiscard]] std::uint64_t hash_text(std::string_view text, std::uint64_t hash = 0xCBF29CE484222325) noexcept {
+	for (auto const character : text) {
+		hash = (hash ^ static_cast<unsigned char>(character)) * 0x100000001B3;
+	}
+	return hash;
+}
+
+[[nodiscard]] std::filesystem::path kernel_directory(kernel_options const& options) {
+	if (!options.cache_directory.empty()) {
+		return options.cache_directory;
+	}
+	if (auto const* const cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+		return std::filesystem::path{cache} / "b_asic" / "kernels";
+	}
+	if (auto const* const home = std::getenv("HOME"); home && *home) {
+		return std::filesystem::path{home} / ".cache" / "b_asic" / "kernels";
+	}
+	return std::filesystem::temp_directory_path() / "b_asic" / "kernels";
+}
+
+#ifndef _WIN32
+// Appended after the flags, so that kernels match run_program bit for bit: products and sums are not contracted to fused
+// multiply-adds, and nothing is reassociated.
+constexpr auto exact_arguments = std::array<char const*, 2>{"-ffp-contract=off", "-fno-fast-math"};
+
+[[nodiscard]] std::vector<std::string> compiler_arguments(kernel_options const& options) {
+	auto arguments = std::vector<std::string>{options.compiler};
+	auto flags = std::istringstream{options.flags};
+	for (auto flag = std::string{}; flags >> flag;) {
+		arguments.push_back(std::move(flag));
+	}
+	arguments.insert(arguments.end(), exact_arguments.begin(), exact_arguments.end());
+	return arguments;
+}
+
+// Run a program without a shell and return whether it succeeded. Its standard output and error are appended to output if given,
+// and go to those of this process otherwise.
+[[nodiscard]] bool run_process(std::vector<std::string> const& arguments, std::string* output) {
+	auto argv = std::vector<char*>{};
+	for (auto const& argument : arguments) {
+		argv.push_back(const_cast<char*>(argument.c_str())); // NOLINT(cppcoreguidelines-pro-type-const-cast)
+	}
+	argv.push_back(nullptr);
+	auto pipe_ends = std::array<int, 2>{-1, -1};
+	auto actions = posix_spawn_file_actions_t{};
+	::posix_spawn_file_actions_init(&actions);
+	if (output) {
+		if (::pipe(pipe_ends.data()) != 0) {
+			::posix_spawn_file_actions_destroy(&actions);
+			return false;
+		}
+		::posix_spawn_file_actions_addclose(&actions, pipe_ends[0]);
+		::posix_spawn_file_actions_adddup2(&actions, pipe_ends[1], STDOUT_FILENO);
+		::posix_spawn_file_actions_adddup2(&actions, pipe_ends[1], STDERR_FILENO);
+		::posix_spawn_file_actions_addclose(&actions, pipe_ends[1]);
+	}
+	auto process = pid_t{};
+	auto const spawned = ::posix_spawnp(&process, argv.front(), &actions, nullptr, argv.data(), environ) == 0;
+	::posix_spawn_file_actions_destroy(&actions);
+	if (output) {
+		::close(pipe_ends[1]);
+		auto buffer = std::array<char, 4096>{};
+		for (;;) {
+			auto const size = ::read(pipe_ends[0], buffer.data(), buffer.size());
+			if (size > 0) {
+				output->append(buffer.data(), static_cast<std::size_t>(size));
+			} else if (size == 0 || errno != EINTR) {
+				break;
+			}
+		}
+		::close(pipe_ends[0]);
+	}
+	if (!spawned) {
+		return false;
+	}
+	auto status = 0;
+	while (::waitpid(process, &status, 0) < 0) {
+		if (errno != EINTR) {
+			return false;
+		}
+	}
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+// What the compiler driver prints about the commands it would run, which includes its version and the target that the flags
+// resolve to, such as the processor and features selected by -march=native. Empty if the compiler cannot be run.
+[[nodiscard]] std::string compiler_identity(std::vector<std::string> arguments) {
+	static auto mutex = std::mutex{};
+	static auto identities = std::unordered_map<std::string, std::string>{};
+	auto key = std::string{};
+	for (auto const& argument : arguments) {
+		key += argument;
+		key.push_back('\0');
+	}
+	auto const lock = std::lock_guard{mutex};
+	if (auto const it = identities.find(key); it != identities.end()) {
+		return it->second;
+	}
+	arguments.insert(arguments.end(), {"-###", "-E", "-x", "c++", "/dev/null"});
+	auto identity = std::string{};
+	if (!run_process(arguments, &identity)) {
+		identity.clear();
+	}
+	return identities.emplace(std::move(key), std::move(identity)).first->second;
+}
+#endif
+
+} // namespace
+
+std::string generate_kernel(program const& code, std::size_t block_size, std::size_t lanes) {
+	ASIC_ASSERT(code.slot_offsets.size() == code.slot_count);
+	auto source = std::string{kernel_prelude};
+	auto out = std::back_inserter(source);
+	fmt::format_to(out, "// {} iterations of {} lanes, {} values and {} delay registers.\n", block_size, lanes, code.value_count,
+				   code.delays.size() * lanes);
+	fmt::format_to(out, "extern \"C\" int {}(double* __restrict v, double* __restrict d, std::size_t count) {{\n", kernel_symbol);
+	for (auto const& line : code.delay_lines) {
+		fmt::format_to(out, "\tstd::copy_n(d + {}, {}, v + {});\n", line.first_register * lanes, line.taps.size() * lanes,
+					   code.slot_offsets[line.taps.back()]);
+	}
+	auto const end = fmt::format("count * {}", lanes);
+	for (auto const& segment : code.segments) {
+		if (segment.recurrent) {
+			fmt::format_to(out, "\tfor (std::size_t i = 0; i < {}; i += {}) {{\n", end, lanes);
+			auto body = std::string{};
+			for (auto const i : range(segment.begin, segment.end)) {
+				generate_instruction(body, code, code.instructions[i], lanes, "i", fmt::format("i + {}", lanes));
+			}
+			// Indent the body of the loop over the iterations.
+			for (auto line_begin = std::size_t{0}; line_begin < body.size();) {
+				auto const line_end = body.find('\n', line_begin) + 1;
+				source.push_back('\t');
+				source.append(body, line_begin, line_end - line_begin);
+				line_begin = line_end;
+			}
+			source.append("\t}\n");
+		} else {
+			for (auto const i : range(segment.begin, segment.end)) {
+				generate_instruction(source, code, code.instructions[i], lanes, "0", end);
+			}
+		}
+	}
+	for (auto const& line : code.delay_lines) {
+		fmt::format_to(out, "\tstd::copy_n(v + {} + count * {}, {}, d + {});\n", code.slot_offsets[line.taps.back()], lanes,
+					   line.taps.size() * lanes, line.first_register * lanes);
+	}
+	source.append("\treturn 0;\n}\n");
+	return source;
+}
+
+std::shared_ptr<kernel const> load_kernel(program const& code, std::size_t block_size, std::size_t lanes, kernel_options const& options) {
+	if (!options.enabled || !supports_real_samples(code) || requires_python(code)) {
+		return nullptr;
+	}
+#ifdef _WIN32
+	// Only the interpreter is available on Windows, where there is no common compiler command line.
+	static_cast<void>(block_size);
+	static_cast<void>(lanes);
+	return nullptr;
+#else
+	auto arguments = compiler_arguments(options);
+	auto const identity = compiler_identity(arguments);
+	if (identity.empty()) {
+		ASIC_DEBUG_MSG("Could not run the compiler for simulation kernels.");
+		return nullptr;
+	}
+	auto const source = generate_kernel(code, block_size, lanes);
+	auto const name = fmt::format("asic_kernel_{:016x}", hash_text(identity, hash_text(source)));
+	try {
+		auto const directory = kernel_directory(options);
+		auto const library = directory / (name + ".so");
+		if (!std::filesystem::exists(library)) {
+			ASIC_DEBUG_MSG("Compiling simulation kernel.");
+			std::filesystem::create_directories(directory);
+			// Other processes may build the same kernel at the same time, so each builds its own and renames it into place.
+			auto const stem = directory / fmt::format("{}.{}", name, ::getpid());
+			auto const source_path = stem.string() + ".cpp";
+			auto const library_path = stem.string() + ".so";
+			if (!(std::ofstream{source_path, std::ios::binary} << source)) {
+				return nullptr;
+			}
+			arguments.insert(arguments.end(), {"-std=c++17", "-shared", "-fPIC", "-o", library_path, source_path});
+			if (!run_process(arguments, nullptr)) {
+				ASIC_DEBUG_MSG("Could not compile simulation kernel.");
+				auto error = std::error_code{};
+				std::filesystem::remove(source_path, error);
+				std::filesystem::remove(library_path, error);
+				return nullptr;
+			}
+			std::filesystem::rename(library_path, library);
+			std::filesystem::rename(source_path, directory / (name + ".cpp"));
+		}
+		auto* const handle = ::dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+		if (!handle) {
+			ASIC_DEBUG_MSG("Could not load simulation kernel.");
+			return nullptr;
+		}
+		auto loaded = kernel{std::shared_ptr<void>{handle, [](void* library_handle) { ::dlclose(library_handle); }}};
+		loaded.function = reinterpret_cast<kernel_function*>(::dlsym(handle, kernel_symbol));
+		if (!loaded.function) {
+			return nullptr;
+		}
+		return std::make_shared<kernel const>(std::move(loaded));
+	} catch (std::filesystem::filesystem_error const&) {
+		ASIC_DEBUG_MSG("Could not cache simulation kernel.");
+		return nullptr;
+	}
+#endif
+}
+
+void run_kernel(kernel const& compiled, span<real_number> values, span<real_number> delays, std::size_t count) {
+	ASIC_ASSERT(compiled.function);
+	if (compiled.function(values.data(), delays.data(), count) != 0) {
+		throw std::runtime_error{"Cannot quantize a value that is not finite."};
+	}
+}
+
+} // namespace asic
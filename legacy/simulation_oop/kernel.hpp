@@ -0,0 +1,48 @@
+#ifndef ASIC_SIMULATION_KERNEL_HPP
+#define ASIC_SIMULATION_KERNEL_HPP
+
+#include "../span.hpp"
+#include "instruction.hpp"
+#include "run.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+namespace asic {
+
+// How native kernels are built. The compiler is run without a shell, with the flags split at whitespace and followed by
+// -ffp-contract=off -fno-fast-math and the options needed to build a shared library. An empty cache directory selects
+// b_asic/kernels in the user's cache directory.
+struct kernel_options final {
+	bool enabled = false;
+	std::string compiler = "c++";
+	std::string flags = "-O3 -march=native";
+	std::string cache_directory{};
+};
+
+using kernel_function = int(real_number* values, real_number* delays, std::size_t count);
+
+// A program compiled to native code for real samples, with its constants and the layout of its values built in.
+struct kernel final {
+	std::shared_ptr<void> library{};
+	kernel_function* function = nullptr;
+};
+
+// Generate the source of a kernel, which evaluates the first count iterations of a block like run_program. The program must
+// support real samples and must not call Python.
+[[nodiscard]] std::string generate_kernel(program const& code, std::size_t block_size, std::size_t lanes);
+
+// Load the kernel of a laid out program from the cache, generating and compiling it first if it is not there. Kernels are cached by
+// a hash of their source, the compiler options, the compiler version and the target that the options resolve to on this machine.
+// Returns nothing if the program cannot be run with real samples, calls Python, or if the kernel could not be built or loaded, in
+// which case the program is left to run_program.
+[[nodiscard]] std::shared_ptr<kernel const> load_kernel(program const& code, std::size_t block_size, std::size_t lanes,
+														kernel_options const& options);
+
+// Evaluate the first count iterations of a block using a kernel, which works on the same values and delays as run_program.
+void run_kernel(kernel const& compiled, span<real_number> values, span<real_number> delays, std::size_t count);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_KERNEL_HPP
@@ -0,0 +1,133 @@
+#include "simulation.hpp"
+
+#define NOMINMAX
+#include <pybind11/pybind11.h>
+
+namespace py = pybind11;
+
+namespace asic {
+
+namespace {
+
+void define_recording_policy(pybind11::module_& module) {
+	using namespace pybind11::literals;
+
+	// clang-format off
+	py::enum_<recording_mode>(module, "RecordingMode")
+		.value("FULL", recording_mode::full, "Save every iteration.")
+		.value("RING", recording_mode::ring, "Save the last length iterations.")
+		.value("DECIMATE", recording_mode::decimate, "Save every iteration that is a multiple of factor.")
+		.value("TRIGGER", recording_mode::trigger,
+			"Save the before iterations preceding the first rising crossing of level by the trigger result, and after iterations from it.");
+
+	py::class_<recording_policy>(module, "RecordingPolicy")
+		.def(py::init([](recording_mode mode, std::size_t length, std::size_t factor, result_key trigger_key, real_number level,
+						 std::size_t before, std::size_t after) {
+				return recording_policy{mode, length, factor, std::move(trigger_key), level, before, after};
+			}),
+			"mode"_a = recording_mode::full, "length"_a = 0, "factor"_a = 1, "trigger_key"_a = "", "level"_a = 0.0, "before"_a = 0,
+			"after"_a = 0,
+			"Policy for which iterations of the probed results are saved.")
+		.def_readwrite("mode", &recording_policy::mode)
+		.def_readwrite("length", &recording_policy::length)
+		.def_readwrite("factor", &recording_policy::factor)
+		.def_readwrite("trigger_key", &recording_policy::trigger_key)
+		.def_readwrite("level", &recording_policy::level)
+		.def_readwrite("before", &recording_policy::before)
+		.def_readwrite("after", &recording_policy::after);
+	// clang-format on
+}
+
+void define_kernel_options(pybind11::module_& module) {
+	using namespace pybind11::literals;
+
+	// clang-format off
+	py::class_<kernel_options>(module, "KernelOptions")
+		.def(py::init([](bool enabled, std::string compiler, std::string flags, std::string cache_directory) {
+				return kernel_options{enabled, std::move(compiler), std::move(flags), std::move(cache_directory)};
+			}),
+			"enabled"_a = false, "compiler"_a = "c++", "flags"_a = "-O3 -march=native", "cache_directory"_a = "",
+			"Options for compiling the simulation program to a native kernel.")
+		.def_readwrite("enabled", &kernel_options::enabled)
+		.def_readwrite("compiler", &kernel_options::compiler)
+		.def_readwrite("flags", &kernel_options::flags)
+		.def_readwrite("cache_directory", &kernel_options::cache_directory);
+	// clang-format on
+}
+
+void define_simulation_class(pybind11::module_& module) {
+	using namespace pybind11::literals;
+
+	// clang-format off
+	py::class_<simulation>(module, "Simulation")
+		.def(py::init<py::handle, std::optional<std::vector<std::optional<input_provider_type>>>, std::size_t, std::size_t,
+					  probe_set_type, recording_policy, kernel_options, bool>(),
+			"sfg"_a, "input_providers"_a = py::none{}, "block_size"_a = simulation::default_block_size, "lanes"_a = 1,
+			"probes"_a = "all", "recording"_a = recording_policy{}, "kernel_options"_a = kernel_options{}, "state_space"_a = false,
+			"SFG Constructor.")
+		.def("set_input", &simulation::set_input,
+			"index"_a, "input_provider"_a,
+			"Set the input function used to get values for the specific input at the given index to the internal SFG.")
+		.def("set_inputs", &simulation::set_inputs,
+			"input_providers"_a,
+			"Set the input functions used to get values for the inputs to the internal SFG.")
+		.def("step", &simulation::step,
+			"save_results"_a = true, "bits_override"_a = py::none{}, "quantize"_a = true, "outputs"_a = py::none{},
+			"advance_delays"_a = false,
+			"Run one iteration of the simulation and return the resulting output values.")
+		.def("run_until", &simulation::run_until,
+			"iteration"_a, "save_results"_a = true, "bits_override"_a = py::none{}, "quantize"_a = true, "outputs"_a = py::none{},
+			"advance_delays"_a = false,
+			"Run the simulation until its iteration is greater than or equal to the given iteration and return the output values of "
+			"the last iteration.")
+		.def("run_for", &simulation::run_for,
+			"iterations"_a, "save_results"_a = true, "bits_override"_a = py::none{}, "quantize"_a = true, "outputs"_a = py::none{},
+			"advance_delays"_a = false,
+			"Run a given number of iterations of the simulation and return the output values of the last iteration.")
+		.def("run", &simulation::run,
+			"save_results"_a = true, "bits_override"_a = py::none{}, "quantize"_a = true, "outputs"_a = py::none{},
+			"advance_delays"_a = false,
+			"Run the simulation until the end of its input arrays and return the output values of the last iteration.")
+		.def_property_readonly("iteration", &simulation::iteration,
+			"Get the current iteration number of the simulation.")
+		.def_property_readonly("lanes", &simulation::lanes,
+			"Get the number of independent lanes that are simulated in each iteration.")
+		.def_property_readonly("trigger_iteration", &simulation::trigger_iteration,
+			"Get the iteration at which the trigger result first crossed its level, or None.")
+		.def_property_readonly("results", &simulation::results,
+			"Get a mapping from result keys to read-only numpy arrays containing the probed results of each saved iteration.")
+		.def("take_results", &simulation::take_results,
+			"Return the saved results as writable numpy arrays and clear them from the simulation.")
+		.def("graph_statistics", &simulation::graph_statistics,
+			"Get the number of operations in the graph and the memory they use.")
+		.def("optimization_statistics", &simulation::optimization_statistics,
+			"Get the number of instructions that were folded, merged and pruned when compiling the simulation.")
+		.def("stream_results", &simulation::stream_results,
+			"path"_a, "iterations"_a, "combined"_a = false,
+			"Stream the probed results of the following iterations into memory-mapped .npy files and return their keys.")
+		.def("close_stream", &simulation::close_stream,
+			"Stop streaming results and close the .npy files.")
+		.def("clear_results", &simulation::clear_results,
+			"Clear all results that were saved until now.")
+		.def("clear_state", &simulation::clear_state,
+			"Clear all current state of the simulation, except for the results and iteration.")
+		.def("snapshot", &simulation::snapshot,
+			"Save the delay registers, the iteration and the state of the native input generators as bytes.")
+		.def("restore", &simulation::restore,
+			"snapshot"_a,
+			"Load a snapshot of a simulation of the same graph.")
+		.def("fork", &simulation::fork,
+			"Make a simulation that continues from a copy of the current state, without any results.");
+	// clang-format on
+}
+
+} // namespace
+
+} // namespace asic
+
+PYBIND11_MODULE(_b_asic, module) {
+	module.doc() = "Better ASIC Toolbox Extension";
+	asic::define_recording_policy(module);
+	asic::define_kernel_options(module);
+	asic::define_simulation_class(module);
+}
@@ -0,0 +1,152 @@
+#include "npy_file.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fmt/format.h>
+#include <stdexcept>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace asic {
+
+namespace {
+
+constexpr auto npy_alignment = std::size_t{64};
+constexpr auto npy_preamble_size = std::size_t{10}; // Magic string, version and header length.
+
+[[nodiscard]] std::string make_npy_header(std::string_view descr, std::vector<std::size_t> const& shape, bool fortran_order) {
+	auto dimensions = std::string{};
+	for (auto&& [i, size] : enumerate(shape)) {
+		dimensions += (i == 0) ? fmt::to_string(size) : fmt::format(", {}", size);
+	}
+	if (shape.size() == 1) {
+		dimensions.push_back(','); // A tuple with one element.
+	}
+	auto dictionary =
+		fmt::format("{{'descr': '{}', 'fortran_order': {}, 'shape': ({}), }}", descr, fortran_order ? "True" : "False", dimensions);
+	auto const padding = npy_alignment - (npy_preamble_size + dictionary.size() + 1) % npy_alignment;
+	dictionary.append(padding % npy_alignment, ' ');
+	dictionary.push_back('\n');
+	if (dictionary.size() > 0xFFFF) {
+		throw std::length_error{"The .npy header is too long."};
+	}
+	auto header = std::string{"\x93NUMPY\x01\x00", 8};
+	header.push_back(static_cast<char>(dictionary.size() & 0xFF));
+	header.push_back(static_cast<char>(dictionary.size() >> 8));
+	return header + dictionary;
+}
+
+} // namespace
+
+npy_file::npy_file(std::string const& path, std::string_view descr, std::vector<std::size_t> const& shape, bool fortran_order,
+				   std::size_t item_size) {
+	auto const header = make_npy_header(descr, shape, fortran_order);
+	auto data_size = item_size;
+	for (auto const size : shape) {
+		data_size *= size;
+	}
+	m_header_size = header.size();
+	m_mapping_size = m_header_size + data_size;
+#ifdef _WIN32
+	m_file = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		throw std::system_error{static_cast<int>(GetLastError()), std::system_category(), fmt::format("Could not create \"{}\"", path)};
+	}
+	auto const size = static_cast<unsigned long long>(m_mapping_size);
+	m_file_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READWRITE, static_cast<DWORD>(size >> 32), static_cast<DWORD>(size), nullptr);
+	if (m_file_mapping) {
+		m_mapping = MapViewOfFile(m_file_mapping, FILE_MAP_WRITE, 0, 0, m_mapping_size);
+	}
+	if (!m_mapping) {
+		auto const error = static_cast<int>(GetLastError());
+		this->close();
+		throw std::system_error{error, std::system_category(), fmt::format("Could not map \"{}\"", path)};
+	}
+#else
+	auto const file = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file == -1) {
+		throw std::system_error{errno, std::generic_category(), fmt::format("Could not create \"{}\"", path)};
+	}
+	if (::ftruncate(file, static_cast<off_t>(m_mapping_size)) == 0) {
+		m_mapping = ::mmap(nullptr, m_mapping_size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	}
+	auto const error = errno;
+	::close(file); // The mapping keeps the file open.
+	if (!m_mapping || m_mapping == MAP_FAILED) {
+		m_mapping = nullptr;
+		throw std::system_error{error, std::generic_category(), fmt::format("Could not map \"{}\"", path)};
+	}
+#endif
+	std::memcpy(m_mapping, header.data(), header.size());
+}
+
+npy_file::~npy_file() {
+	this->close();
+}
+
+npy_file::npy_file(npy_file&& other) noexcept
+	: m_mapping(std::exchange(other.m_mapping, nullptr))
+	, m_mapping_size(std::exchange(other.m_mapping_size, 0))
+	, m_header_size(std::exchange(other.m_header_size, 0))
+#ifdef _WIN32
+	, m_file(std::exchange(other.m_file, nullptr))
+	, m_file_mapping(std::exchange(other.m_file_mapping, nullptr))
+#endif
+{
+}
+
+npy_file& npy_file::operator=(npy_file&& other) noexcept {
+	if (this != &other) {
+		this->close();
+		m_mapping = std::exchange(other.m_mapping, nullptr);
+		m_mapping_size = std::exchange(other.m_mapping_size, 0);
+		m_header_size = std::exchange(other.m_header_size, 0);
+#ifdef _WIN32
+		m_file = std::exchange(other.m_file, nullptr);
+		m_file_mapping = std::exchange(other.m_file_mapping, nullptr);
+#endif
+	}
+	return *this;
+}
+
+void* npy_file::data() const noexcept {
+	ASIC_ASSERT(m_mapping);
+	return static_cast<char*>(m_mapping) + m_header_size;
+}
+
+void npy_file::close() noexcept {
+#ifdef _WIN32
+	if (m_mapping) {
+		UnmapViewOfFile(m_mapping);
+	}
+	if (m_file_mapping) {
+		CloseHandle(m_file_mapping);
+	}
+	if (m_file) {
+		CloseHandle(m_file);
+	}
+	m_file_mapping = nullptr;
+	m_file = nullptr;
+#else
+	if (m_mapping) {
+		::munmap(m_mapping, m_mapping_size);
+	}
+#endif
+	m_mapping = nullptr;
+}
+
+} // namespace asic
@@ -0,0 +1,40 @@
+#ifndef ASIC_SIMULATION_NPY_FILE_HPP
+#define ASIC_SIMULATION_NPY_FILE_HPP
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace asic {
+
+// A preallocated .npy file that is mapped into memory, so that its data can be written in place while other processes read it,
+// for example using numpy.load(path, mmap_mode="r").
+class npy_file final {
+public:
+	npy_file(std::string const& path, std::string_view descr, std::vector<std::size_t> const& shape, bool fortran_order,
+			 std::size_t item_size);
+	~npy_file();
+
+	npy_file(npy_file const&) = delete;
+	npy_file(npy_file&& other) noexcept;
+	npy_file& operator=(npy_file const&) = delete;
+	npy_file& operator=(npy_file&& other) noexcept;
+
+	[[nodiscard]] void* data() const noexcept;
+
+private:
+	void close() noexcept;
+
+	void* m_mapping = nullptr;
+	std::size_t m_mapping_size = 0;
+	std::size_t m_header_size = 0;
+#ifdef _WIN32
+	void* m_file = nullptr;
+	void* m_file_mapping = nullptr;
+#endif
+};
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_NPY_FILE_HPP
@@ -1,6 +1,10 @@
 #include "operation.hpp"
 
+#include "../algorithm.hpp"
 #include "../debug.hpp"
+#include "operation_graph.hpp"
+
+#include <algorithm>
 
 #define NOMINMAX
 #include <pybind11/pybind11.h>
@@ -9,64 +13,137 @@ namespace py = pybind11;
 
 namespace asic {
 
-signal_source::signal_source(std::shared_ptr<const operation> op, std::size_t index, std::optional<std::size_t> bits)
-	: m_operation(std::move(op))
-	, m_index(index)
-	, m_bits(bits) {}
+namespace {
 
-signal_source::operator bool() const noexcept {
-	return static_cast<bool>(m_operation);
+[[nodiscard]] slot_index quantize_fixed_point(std::size_t index, slot_index value, fixed_point_format const& format,
+											 compilation_context const& context) {
+	auto const word_length = format.integer_bits + format.fractional_bits;
+	if (word_length < 1 || word_length > max_fixed_point_word_length) {
+		throw py::value_error{fmt::format("Cannot quantize to {} (expected 1-{}) bits as requested by the signal connected to input #{}",
+										  word_length, max_fixed_point_word_length, index)};
+	}
+	auto const format_index = static_cast<std::uint32_t>(context.code->formats.size());
+	context.code->formats.push_back(format);
+	return context.code->emit(opcode::fixed_point_quantize, {value, no_slot, no_slot}, format_index);
+}
+
+// The bypassed outputs quantize the value when overriding the number of bits, which gives the same value however many of them there
+// are. Delays store the quantized value as well.
+[[nodiscard]] slot_index compile_aliases(std::vector<result_key> const& keys, slot_index slot, compilation_context const& context) {
+	auto alias_slot = slot;
+	if (context.quantize && context.bits_override && *context.bits_override != 0) {
+		auto const it = std::find_if(keys.begin(), keys.end(), [&](result_key const& key) { return context.slots->count(key) != 0; });
+		alias_slot = (it != keys.end()) ? context.slots->at(*it).value()
+										: context.code->emit(opcode::quantize, {slot, no_slot, no_slot}, 0,
+															 static_cast<std::uint32_t>(*context.bits_override));
+	}
+	for (auto const& key : keys) {
+		if (context.slots->try_emplace(key, alias_slot).second) {
+			context.code->result_keys.push_back(key);
+			context.code->result_slots.push_back(alias_slot);
+		}
+	}
+	return alias_slot;
 }
 
-std::optional<number> signal_source::current_output(delay_map const& delays) const {
-	ASIC_ASSERT(m_operation);
-	return m_operation->current_output(m_index, delays);
+} // namespace
+
+signal_source::signal_source(node_index node, std::size_t index, std::optional<std::size_t> bits, std::optional<fixed_point_format> format)
+	: m_node(node)
+	, m_index(static_cast<std::uint32_t>(index))
+	, m_bits(bits)
+	, m_format(format) {}
+
+signal_source::operator bool() const noexcept {
+	return m_node != no_node;
 }
 
-number signal_source::evaluate_output(evaluation_context const& context) const {
-	ASIC_ASSERT(m_operation);
-	return m_operation->evaluate_output(m_index, context);
+slot_index signal_source::compile_output(compilation_context const& context) const {
+	ASIC_ASSERT(m_node != no_node);
+	ASIC_ASSERT(context.graph);
+	auto const slot = context.graph->node(m_node).compile_output(m_index, context);
+	if (m_aliases != no_aliases) {
+		return compile_aliases(context.graph->aliases(m_aliases), slot, context);
+	}
+	return slot;
 }
 
 std::optional<std::size_t> signal_source::bits() const noexcept {
 	return m_bits;
 }
 
-abstract_operation::abstract_operation(result_key key)
-	: m_key(std::move(key)) {}
+std::optional<fixed_point_format> const& signal_source::format() const noexcept {
+	return m_format;
+}
+
+void signal_source::bypass(operation_graph& graph) {
+	ASIC_ASSERT(m_aliases == no_aliases);
+	auto keys = std::vector<result_key>{};
+	// Forwarding outputs that only lead back to themselves are left for compilation to report.
+	for (auto steps = graph.node_count(); m_node != no_node && steps > 0; --steps) {
+		auto forwarded = graph.node(m_node).forwarded_output(m_index);
+		if (!forwarded || forwarded->source->bits() || forwarded->source->format()) {
+			break;
+		}
+		auto const& source = *forwarded->source;
+		keys.push_back(std::move(forwarded->key));
+		if (source.m_aliases != no_aliases) {
+			auto const& source_keys = graph.aliases(source.m_aliases);
+			keys.insert(keys.end(), source_keys.begin(), source_keys.end());
+		}
+		m_node = source.m_node;
+		m_index = source.m_index;
+	}
+	if (!keys.empty()) {
+		m_aliases = graph.add_aliases(std::move(keys));
+	}
+}
 
-std::optional<number> abstract_operation::current_output(std::size_t, delay_map const&) const {
+std::optional<forwarded_signal> operation::forwarded_output(std::size_t) const {
 	return std::nullopt;
 }
 
-number abstract_operation::evaluate_output(std::size_t index, evaluation_context const& context) const {
+void operation::bypass_inputs(operation_graph&) {}
+
+abstract_operation::abstract_operation(result_key key)
+	: m_key(std::move(key)) {}
+
+slot_index abstract_operation::compile_output(std::size_t index, compilation_context const& context) const {
 	ASIC_ASSERT(index < this->output_count());
-	ASIC_ASSERT(context.results);
-	auto const key = this->key_of_output(index);
-	if (auto const it = context.results->find(key); it != context.results->end()) {
+	ASIC_ASSERT(context.code);
+	ASIC_ASSERT(context.slots);
+	auto key = this->key_of_output(index);
+	if (auto const it = context.slots->find(key); it != context.slots->end()) {
 		if (it->second) {
 			return *it->second;
 		}
-		throw std::runtime_error{"Direct feedback loop detected when evaluating simulation operation."};
-	}
-	auto& result = context.results->try_emplace(key, this->current_output(index, *context.delays))
-					   .first->second; // Use a reference to avoid potential iterator invalidation caused by evaluate_output_impl.
-	auto const value = this->evaluate_output_impl(index, context);
-	ASIC_ASSERT(&context.results->at(key) == &result);
-	result = value;
-	return value;
-}
-
-number abstract_operation::quantize_input(std::size_t index, number value, std::size_t bits) const {
-	if (value.imag() != 0) {
-		throw py::type_error{
-			fmt::format("Complex value cannot be quantized to {} bits as requested by the signal connected to input #{}", bits, index)};
+		throw std::runtime_error{"Direct feedback loop detected when compiling simulation operation."};
 	}
+	context.slots->try_emplace(key, std::nullopt);
+	auto const slot = this->compile_output_impl(index, context);
+	context.slots->at(key) = slot; // Look up the key again since compile_output_impl may have caused a rehash.
+	context.code->result_keys.push_back(std::move(key));
+	context.code->result_slots.push_back(slot);
+	return slot;
+}
+
+slot_index abstract_operation::quantize_input(std::size_t index, slot_index value, std::size_t bits,
+											  compilation_context const& context) const {
 	if (bits > 64) {
 		throw py::value_error{
 			fmt::format("Cannot quantize to {} (more than 64) bits as requested by the singal connected to input #{}", bits, index)};
 	}
-	return number{static_cast<number::value_type>(static_cast<std::int64_t>(value.real()) & ((std::int64_t{1} << bits) - 1))};
+	return context.code->emit(
+		opcode::quantize, {value, no_slot, no_slot}, static_cast<std::uint32_t>(index), static_cast<std::uint32_t>(bits));
+}
+
+slot_index abstract_operation::compile_source(std::size_t index, signal_source const& source, compilation_context const& context) const {
+	auto const value = source.compile_output(context);
+	if (context.quantize && !context.bits_override && source.format()) {
+		return quantize_fixed_point(index, value, *source.format(), context);
+	}
+	auto const bits = context.bits_override.value_or(source.bits().value_or(0));
+	return (context.quantize && bits != 0) ? this->quantize_input(index, value, bits, context) : value;
 }
 
 result_key const& abstract_operation::key_base() const {
@@ -90,6 +167,10 @@ void unary_operation::connect(signal_source in) {
 	m_in = std::move(in);
 }
 
+void unary_operation::bypass_inputs(operation_graph& graph) {
+	m_in.bypass(graph);
+}
+
 bool unary_operation::connected() const noexcept {
 	return static_cast<bool>(m_in);
 }
@@ -98,10 +179,8 @@ signal_source const& unary_operation::input() const noexcept {
 	return m_in;
 }
 
-number unary_operation::evaluate_input(evaluation_context const& context) const {
-	auto const value = m_in.evaluate_output(context);
-	auto const bits = context.bits_override.value_or(m_in.bits().value_or(0));
-	return (context.quantize && bits != 0) ? this->quantize_input(0, value, bits) : value;
+slot_index unary_operation::compile_input(compilation_context const& context) const {
+	return this->compile_source(0, m_in, context);
 }
 
 binary_operation::binary_operation(result_key key)
@@ -112,6 +191,11 @@ void binary_operation::connect(signal_source lhs, signal_source rhs) {
 	m_rhs = std::move(rhs);
 }
 
+void binary_operation::bypass_inputs(operation_graph& graph) {
+	m_lhs.bypass(graph);
+	m_rhs.bypass(graph);
+}
+
 signal_source const& binary_operation::lhs() const noexcept {
 	return m_lhs;
 }
@@ -120,16 +204,12 @@ signal_source const& binary_operation::rhs() const noexcept {
 	return m_rhs;
 }
 
-number binary_operation::evaluate_lhs(evaluation_context const& context) const {
-	auto const value = m_lhs.evaluate_output(context);
-	auto const bits = context.bits_override.value_or(m_lhs.bits().value_or(0));
-	return (context.quantize && bits != 0) ? this->quantize_input(0, value, bits) : value;
+slot_index binary_operation::compile_lhs(compilation_context const& context) const {
+	return this->compile_source(0, m_lhs, context);
 }
 
-number binary_operation::evaluate_rhs(evaluation_context const& context) const {
-	auto const value = m_rhs.evaluate_output(context);
-	auto const bits = context.bits_override.value_or(m_rhs.bits().value_or(0));
-	return (context.quantize && bits != 0) ? this->quantize_input(0, value, bits) : value;
+slot_index binary_operation::compile_rhs(compilation_context const& context) const {
+	return this->compile_source(1, m_rhs, context);
 }
 
 nary_operation::nary_operation(result_key key)
@@ -139,19 +219,23 @@ void nary_operation::connect(std::vector<signal_source> inputs) {
 	m_inputs = std::move(inputs);
 }
 
+void nary_operation::bypass_inputs(operation_graph& graph) {
+	for (auto& input : m_inputs) {
+		input.bypass(graph);
+	}
+}
+
 span<signal_source const> nary_operation::inputs() const noexcept {
 	return m_inputs;
 }
 
-std::vector<number> nary_operation::evaluate_inputs(evaluation_context const& context) const {
-	auto values = std::vector<number>{};
-	values.reserve(m_inputs.size());
-	for (auto const& input : m_inputs) {
-		auto const value = input.evaluate_output(context);
-		auto const bits = context.bits_override.value_or(input.bits().value_or(0));
-		values.push_back((context.quantize && bits != 0) ? this->quantize_input(0, value, bits) : value);
+std::vector<slot_index> nary_operation::compile_inputs(compilation_context const& context) const {
+	auto slots = std::vector<slot_index>{};
+	slots.reserve(m_inputs.size());
+	for (auto const& [i, input] : enumerate(m_inputs)) {
+		slots.push_back(this->compile_source(i, input, context));
 	}
-	return values;
+	return slots;
 }
 
 } // namespace asic
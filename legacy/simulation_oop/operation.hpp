@@ -3,6 +3,7 @@
 
 #include "../number.hpp"
 #include "../span.hpp"
+#include "instruction.hpp"
 
 #include <cstddef>
 #include <cstdint>
@@ -18,16 +19,24 @@
 namespace asic {
 
 class operation;
+class operation_graph;
 class signal_source;
 
-using result_key = std::string;
-using result_map = std::unordered_map<result_key, std::optional<number>>;
-using delay_map = std::unordered_map<result_key, number>;
-using delay_queue = std::vector<std::pair<result_key, signal_source const*>>;
+using node_index = std::uint32_t;
 
-struct evaluation_context final {
-	result_map* results = nullptr;
-	delay_map* delays = nullptr;
+constexpr auto no_node = static_cast<node_index>(-1);
+
+using alias_index = std::uint32_t;
+
+constexpr auto no_aliases = static_cast<alias_index>(-1);
+
+using slot_map = std::unordered_map<result_key, std::optional<slot_index>>;
+using delay_queue = std::vector<std::pair<std::size_t, signal_source const*>>; // Delay instruction index and its input.
+
+struct compilation_context final {
+	operation_graph const* graph = nullptr;
+	program* code = nullptr;
+	slot_map* slots = nullptr;
 	delay_queue* deferred_delays = nullptr;
 	std::optional<std::size_t> bits_override{};
 	bool quantize = false;
@@ -36,19 +45,31 @@ struct evaluation_context final {
 class signal_source final {
 public:
 	signal_source() noexcept = default;
-	signal_source(std::shared_ptr<const operation> op, std::size_t index, std::optional<std::size_t> bits);
+	signal_source(node_index node, std::size_t index, std::optional<std::size_t> bits,
+				  std::optional<fixed_point_format> format = std::nullopt);
 
 	[[nodiscard]] explicit operator bool() const noexcept;
 
-	[[nodiscard]] std::optional<number> current_output(delay_map const& delays) const;
-	[[nodiscard]] number evaluate_output(evaluation_context const& context) const;
+	[[nodiscard]] slot_index compile_output(compilation_context const& context) const;
 
 	[[nodiscard]] std::optional<std::size_t> bits() const noexcept;
+	[[nodiscard]] std::optional<fixed_point_format> const& format() const noexcept;
+
+	// Refer directly to the source of any outputs that forward the signal without quantizing it, like the inputs and outputs of
+	// nested graphs. Their result keys are kept as aliases of the value.
+	void bypass(operation_graph& graph);
 
 private:
-	std::shared_ptr<const operation> m_operation{};
-	std::size_t m_index = 0;
+	node_index m_node = no_node;
+	std::uint32_t m_index = 0;
+	alias_index m_aliases = no_aliases;
 	std::optional<std::size_t> m_bits{};
+	std::optional<fixed_point_format> m_format{};
+};
+
+struct forwarded_signal final {
+	result_key key;
+	signal_source const* source = nullptr;
 };
 
 class operation { // NOLINT(cppcoreguidelines-special-member-functions)
@@ -57,8 +78,11 @@ public:
 	virtual ~operation() = default;
 
 	[[nodiscard]] virtual std::size_t output_count() const noexcept = 0;
-	[[nodiscard]] virtual std::optional<number> current_output(std::size_t index, delay_map const& delays) const = 0;
-	[[nodiscard]] virtual number evaluate_output(std::size_t index, evaluation_context const& context) const = 0;
+	[[nodiscard]] virtual slot_index compile_output(std::size_t index, compilation_context const& context) const = 0;
+
+	// The signal that an output passes on unchanged, if it only connects other operations.
+	[[nodiscard]] virtual std::optional<forwarded_signal> forwarded_output(std::size_t index) const;
+	virtual void bypass_inputs(operation_graph& graph);
 };
 
 class abstract_operation : public operation { // NOLINT(cppcoreguidelines-special-member-functions)
@@ -66,12 +90,13 @@ public:
 	explicit abstract_operation(result_key key);
 	~abstract_operation() override = default;
 
-	[[nodiscard]] std::optional<number> current_output(std::size_t, delay_map const&) const override;
-	[[nodiscard]] number evaluate_output(std::size_t index, evaluation_context const& context) const override;
+	[[nodiscard]] slot_index compile_output(std::size_t index, compilation_context const& context) const override;
 
 protected:
-	[[nodiscard]] virtual number evaluate_output_impl(std::size_t index, evaluation_context const& context) const = 0;
-	[[nodiscard]] virtual number quantize_input(std::size_t index, number value, std::size_t bits) const;
+	[[nodiscard]] virtual slot_index compile_output_impl(std::size_t index, compilation_context const& context) const = 0;
+	[[nodiscard]] virtual slot_index quantize_input(std::size_t index, slot_index value, std::size_t bits,
+													compilation_context const& context) const;
+	[[nodiscard]] slot_index compile_source(std::size_t index, signal_source const& source, compilation_context const& context) const;
 
 	[[nodiscard]] result_key const& key_base() const;
 	[[nodiscard]] result_key key_of_output(std::size_t index) const;
@@ -86,11 +111,12 @@ public:
 	~unary_operation() override = default;
 
 	void connect(signal_source in);
+	void bypass_inputs(operation_graph& graph) override;
 
 protected:
 	[[nodiscard]] bool connected() const noexcept;
 	[[nodiscard]] signal_source const& input() const noexcept;
-	[[nodiscard]] number evaluate_input(evaluation_context const& context) const;
+	[[nodiscard]] slot_index compile_input(compilation_context const& context) const;
 
 private:
 	signal_source m_in;
@@ -102,12 +128,13 @@ public:
 	~binary_operation() override = default;
 
 	void connect(signal_source lhs, signal_source rhs);
+	void bypass_inputs(operation_graph& graph) override;
 
 protected:
 	[[nodiscard]] signal_source const& lhs() const noexcept;
 	[[nodiscard]] signal_source const& rhs() const noexcept;
-	[[nodiscard]] number evaluate_lhs(evaluation_context const& context) const;
-	[[nodiscard]] number evaluate_rhs(evaluation_context const& context) const;
+	[[nodiscard]] slot_index compile_lhs(compilation_context const& context) const;
+	[[nodiscard]] slot_index compile_rhs(compilation_context const& context) const;
 
 private:
 	signal_source m_lhs;
@@ -120,10 +147,11 @@ public:
 	~nary_operation() override = default;
 
 	void connect(std::vector<signal_source> inputs);
+	void bypass_inputs(operation_graph& graph) override;
 
 protected:
 	[[nodiscard]] span<signal_source const> inputs() const noexcept;
-	[[nodiscard]] std::vector<number> evaluate_inputs(evaluation_context const& context) const;
+	[[nodiscard]] std::vector<slot_index> compile_inputs(compilation_context const& context) const;
 
 private:
 	std::vector<signal_source> m_inputs{};
@@ -0,0 +1,52 @@
+#include "operation_graph.hpp"
+
+#include <algorithm>
+
+namespace asic {
+
+namespace {
+
+constexpr auto min_chunk_size = std::size_t{64 * 1024};
+
+} // namespace
+
+operation_graph::~operation_graph() {
+	// Operations only refer to each other by index, so any destruction order works. Reverse order mirrors construction.
+	for (auto it = m_nodes.rbegin(); it != m_nodes.rend(); ++it) {
+		(*it)->~operation();
+	}
+}
+
+void operation_graph::bypass_forwarded_signals() {
+	for (auto* const node : m_nodes) {
+		node->bypass_inputs(*this);
+	}
+}
+
+std::size_t operation_graph::node_count() const noexcept {
+	return m_nodes.size();
+}
+
+std::size_t operation_graph::size_bytes() const noexcept {
+	return m_size_bytes + m_nodes.capacity() * sizeof(operation*);
+}
+
+alias_index operation_graph::add_aliases(std::vector<result_key> keys) {
+	m_aliases.push_back(std::move(keys));
+	return static_cast<alias_index>(m_aliases.size() - 1);
+}
+
+void* operation_graph::allocate(std::size_t size, std::size_t alignment) {
+	auto offset = (m_chunk_used + alignment - 1) / alignment * alignment;
+	if (m_chunks.empty() || offset + size > m_chunk_size) {
+		// Memory from operator new[] is aligned for any fundamental type, which covers all operations.
+		m_chunk_size = std::max(min_chunk_size, size);
+		m_chunks.push_back(std::make_unique<std::byte[]>(m_chunk_size));
+		offset = 0;
+	}
+	m_chunk_used = offset + size;
+	m_size_bytes += size;
+	return m_chunks.back().get() + offset;
+}
+
+} // namespace asic
@@ -0,0 +1,72 @@
+#ifndef ASIC_SIMULATION_OPERATION_GRAPH_HPP
+#define ASIC_SIMULATION_OPERATION_GRAPH_HPP
+
+#include "../debug.hpp"
+#include "operation.hpp"
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace asic {
+
+// Owns the operations of a simulation. They are allocated consecutively in large chunks in the order they are created, and refer
+// to each other by node index, so building and compiling the graph touches little memory and needs no reference counting.
+class operation_graph final {
+public:
+	operation_graph() noexcept = default;
+	~operation_graph();
+
+	operation_graph(operation_graph const&) = delete;
+	operation_graph(operation_graph&&) noexcept = default;
+	operation_graph& operator=(operation_graph const&) = delete;
+	operation_graph& operator=(operation_graph&&) noexcept = delete;
+
+	template <typename Operation, typename... Args>
+	[[nodiscard]] std::pair<node_index, Operation*> emplace(Args&&... args) {
+		auto* const new_op = new (this->allocate(sizeof(Operation), alignof(Operation))) Operation(std::forward<Args>(args)...);
+		m_nodes.push_back(new_op);
+		return {static_cast<node_index>(m_nodes.size() - 1), new_op};
+	}
+
+	[[nodiscard]] operation const& node(node_index index) const noexcept {
+		ASIC_ASSERT(index < m_nodes.size());
+		return *m_nodes[index];
+	}
+
+	template <typename Operation>
+	[[nodiscard]] Operation& get(node_index index) const noexcept {
+		ASIC_ASSERT(index < m_nodes.size());
+		return static_cast<Operation&>(*m_nodes[index]);
+	}
+
+	// Let every operation read directly from the operations that nested graphs forward signals from, so that compiling the graph
+	// goes straight through their inputs and outputs.
+	void bypass_forwarded_signals();
+
+	[[nodiscard]] std::size_t node_count() const noexcept;
+	[[nodiscard]] std::size_t size_bytes() const noexcept; // Memory used by the nodes themselves and the node table.
+
+	// The result keys of the outputs that a bypassed signal passes through, which still name its value in the results.
+	[[nodiscard]] alias_index add_aliases(std::vector<result_key> keys);
+	[[nodiscard]] std::vector<result_key> const& aliases(alias_index index) const noexcept {
+		ASIC_ASSERT(index < m_aliases.size());
+		return m_aliases[index];
+	}
+
+private:
+	[[nodiscard]] void* allocate(std::size_t size, std::size_t alignment);
+
+	std::vector<operation*> m_nodes{};
+	std::vector<std::vector<result_key>> m_aliases{};
+	std::vector<std::unique_ptr<std::byte[]>> m_chunks{};
+	std::size_t m_chunk_used = 0;
+	std::size_t m_chunk_size = 0;
+	std::size_t m_size_bytes = 0;
+};
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_OPERATION_GRAPH_HPP
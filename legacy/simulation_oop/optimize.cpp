@@ -0,0 +1,230 @@
+#include "optimize.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+#include "run.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <utility>
+
+namespace asic {
+
+namespace {
+
+constexpr auto no_instruction = std::numeric_limits<std::size_t>::max();
+
+using instruction_key = std::array<std::uint64_t, 7>;
+
+[[nodiscard]] bool has_state(opcode type) noexcept {
+	switch (type) {
+		case opcode::delay:
+		case opcode::store_delay:
+		case opcode::delay_line:
+		case opcode::custom:
+		case opcode::custom_quantize:
+			// Python operations may have side effects, so they are kept even if their values are identical or unused.
+			return true;
+		default:
+			return false;
+	}
+}
+
+[[nodiscard]] bool is_finite(number value) noexcept {
+	return std::isfinite(value.real()) && std::isfinite(value.imag());
+}
+
+// Constants are compared bit for bit, so that zeros of different signs and NaNs stay apart.
+[[nodiscard]] std::pair<std::uint64_t, std::uint64_t> constant_bits(number value) noexcept {
+	auto const real = value.real();
+	auto const imag = value.imag();
+	auto bits = std::pair<std::uint64_t, std::uint64_t>{};
+	std::memcpy(&bits.first, &real, sizeof(real));
+	std::memcpy(&bits.second, &imag, sizeof(imag));
+	return bits;
+}
+
+[[nodiscard]] instruction_key make_key(program const& code, instruction const& instruction) {
+	auto key = instruction_key{static_cast<std::uint64_t>(instruction.type),
+							   instruction.operands[0],
+							   instruction.operands[1],
+							   instruction.operands[2],
+							   instruction.index,
+							   0,
+							   instruction.bits};
+	switch (instruction.type) {
+		case opcode::constant:
+		case opcode::constant_multiplication:
+		case opcode::symmetric_twoport_adaptor:
+			std::tie(key[4], key[5]) = constant_bits(code.constants[instruction.index]);
+			break;
+		case opcode::fixed_point_quantize: {
+			auto const& format = code.formats[instruction.index];
+			auto const integer_bits = static_cast<std::uint32_t>(format.integer_bits);
+			auto const fractional_bits = static_cast<std::uint32_t>(format.fractional_bits);
+			key[4] = (std::uint64_t{integer_bits} << 32) | fractional_bits;
+			key[5] = static_cast<std::uint64_t>(format.quantization) | (static_cast<std::uint64_t>(format.overflow) << 8);
+			break;
+		}
+		case opcode::addition:
+		case opcode::multiplication:
+			// Exactly commutative, also for complex samples.
+			if (key[1] > key[2]) {
+				std::swap(key[1], key[2]);
+			}
+			break;
+		default:
+			break;
+	}
+	return key;
+}
+
+} // namespace
+
+optimization_report optimize(program& code, span<std::size_t const> live_results) {
+	ASIC_ASSERT(code.delay_lines.empty());
+	auto report = optimization_report{};
+	auto replacements = std::vector<slot_index>(code.slot_count);
+	for (auto const slot : range(code.slot_count)) {
+		replacements[slot] = static_cast<slot_index>(slot);
+	}
+	auto const replace = [&](slot_index& slot) {
+		if (slot != no_slot) {
+			slot = replacements[slot];
+		}
+	};
+
+	// The operands of an instruction are evaluated before it, apart from the inputs of delays, so one pass in order finds every
+	// constant and duplicate.
+	auto constants = std::vector<std::optional<number>>(code.slot_count);
+	auto merged = std::vector<bool>(code.instructions.size(), false);
+	auto computed = std::map<instruction_key, slot_index>{};
+	for (auto&& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.type == opcode::delay || instruction.type == opcode::store_delay) {
+			continue;
+		}
+		for (auto& operand : instruction.operands) {
+			replace(operand);
+		}
+		if (instruction.type == opcode::custom || instruction.type == opcode::custom_quantize) {
+			for (auto& input : code.custom_calls[instruction.index].inputs) {
+				replace(input);
+			}
+			continue;
+		}
+		if (instruction.type != opcode::constant) {
+			auto operands = std::array<number, 3>{};
+			auto foldable = true;
+			for (auto&& [operand, value] : zip(instruction.operands, operands)) {
+				if (operand != no_slot) {
+					foldable = foldable && constants[operand].has_value();
+					value = constants[operand].value_or(number{});
+				}
+			}
+			// Values that are not finite are left to the run, where real samples may give other results than complex ones.
+			if (auto const value = foldable ? evaluate_constant(code, instruction, operands) : std::nullopt; value && is_finite(*value)) {
+				auto const index = static_cast<std::uint32_t>(code.constants.size());
+				code.constants.push_back(*value);
+				instruction = asic::instruction{opcode::constant, instruction.result, {no_slot, no_slot, no_slot}, index};
+				++report.folded;
+			}
+		}
+		if (instruction.type == opcode::constant) {
+			constants[instruction.result] = code.constants[instruction.index];
+		}
+		auto const [it, inserted] = computed.try_emplace(make_key(code, instruction), instruction.result);
+		if (!inserted) {
+			replacements[instruction.result] = it->second;
+			merged[i] = true;
+			++report.merged;
+		}
+	}
+	for (auto& instruction : code.instructions) {
+		if (instruction.type == opcode::delay || instruction.type == opcode::store_delay) {
+			replace(instruction.operands[0]);
+		}
+	}
+	for (auto& slot : code.output_slots) {
+		replace(slot);
+	}
+	for (auto& slot : code.result_slots) {
+		replace(slot);
+	}
+
+	auto producers = std::vector<std::size_t>(code.slot_count, no_instruction);
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (!merged[i] && instruction.result != no_slot) {
+			producers[instruction.result] = i;
+		}
+	}
+	auto live = std::vector<bool>(code.instructions.size(), false);
+	auto pending = std::vector<std::size_t>{};
+	auto const use = [&](slot_index slot) {
+		if (slot == no_slot) {
+			return;
+		}
+		if (auto const producer = producers[slot]; producer != no_instruction && !live[producer]) {
+			live[producer] = true;
+			pending.push_back(producer);
+		}
+	};
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (!merged[i] && has_state(instruction.type)) {
+			live[i] = true;
+			pending.push_back(i);
+		}
+	}
+	for (auto const slot : code.output_slots) {
+		use(slot);
+	}
+	for (auto const result : live_results) {
+		use(code.result_slots[result]);
+	}
+	while (!pending.empty()) {
+		auto const& instruction = code.instructions[pending.back()];
+		pending.pop_back();
+		for (auto const operand : instruction.operands) {
+			use(operand);
+		}
+		if (instruction.type == opcode::custom || instruction.type == opcode::custom_quantize) {
+			for (auto const input : code.custom_calls[instruction.index].inputs) {
+				use(input);
+			}
+		}
+	}
+
+	auto evaluated = std::vector<bool>(code.slot_count, false);
+	for (auto const slot : code.input_slots) {
+		if (slot != no_slot) {
+			evaluated[slot] = true;
+		}
+	}
+	auto instructions = std::vector<instruction>{};
+	instructions.reserve(code.instructions.size());
+	for (auto&& [i, instruction] : enumerate(code.instructions)) {
+		if (live[i]) {
+			if (instruction.result != no_slot) {
+				evaluated[instruction.result] = true;
+			}
+			instructions.push_back(instruction);
+		} else if (!merged[i]) {
+			++report.pruned;
+		}
+	}
+	code.instructions = std::move(instructions);
+	for (auto&& [key, slot] : zip(code.result_keys, code.result_slots)) {
+		if (slot != no_slot && !evaluated[slot]) {
+			report.removed_keys.push_back(key);
+		}
+	}
+	ASIC_DEBUG_MSG("Optimized simulation program.");
+	return report;
+}
+
+} // namespace asic
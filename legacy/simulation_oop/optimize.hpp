@@ -0,0 +1,26 @@
+#ifndef ASIC_SIMULATION_OPTIMIZE_HPP
+#define ASIC_SIMULATION_OPTIMIZE_HPP
+
+#include "../span.hpp"
+#include "instruction.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace asic {
+
+struct optimization_report final {
+	std::size_t folded = 0; // Instructions replaced by constants.
+	std::size_t merged = 0; // Instructions replaced by an identical earlier instruction.
+	std::size_t pruned = 0; // Instructions whose values are not needed.
+	std::vector<result_key> removed_keys{}; // Results that are no longer evaluated, since nothing needs them.
+};
+
+// Fold instructions whose operands are all constant, merge instructions that compute the same value and prune the instructions
+// that no output, delay, Python operation or live result depends on. live_results holds indices into the result tables, and the
+// other results may refer to slots that are no longer evaluated. Must run before collapsing delay chains.
+[[nodiscard]] optimization_report optimize(program& code, span<std::size_t const> live_results);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_OPTIMIZE_HPP
@@ -0,0 +1,152 @@
+#include "output_cone.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+#include "schedule.hpp"
+
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace asic {
+
+namespace {
+
+constexpr auto no_instruction = std::numeric_limits<std::size_t>::max();
+
+} // namespace
+
+program output_cone(program const& code, span<std::size_t const> outputs, span<std::size_t const> live_results, bool advance_delays) {
+	auto producers = std::vector<std::size_t>(code.slot_count, no_instruction);
+	auto stores = std::vector<std::size_t>(code.delays.size(), no_instruction);
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.result != no_slot) {
+			producers[instruction.result] = i;
+		}
+		if (instruction.type == opcode::delay_line) {
+			for (auto const tap : code.delay_lines[instruction.index].taps) {
+				producers[tap] = i;
+			}
+		} else if (instruction.type == opcode::store_delay) {
+			stores[instruction.index] = i;
+		}
+	}
+
+	auto live = std::vector<bool>(code.instructions.size(), false);
+	auto pending = std::vector<std::size_t>{};
+	auto const mark = [&](std::size_t i) {
+		if (i != no_instruction && !live[i]) {
+			live[i] = true;
+			pending.push_back(i);
+		}
+	};
+	auto const use = [&](slot_index slot) {
+		if (slot != no_slot) {
+			mark(producers[slot]);
+		}
+	};
+	for (auto const output : outputs) {
+		use(code.output_slots[output]);
+	}
+	for (auto const result : live_results) {
+		use(code.result_slots[result]);
+	}
+	if (advance_delays) {
+		for (auto const& [i, instruction] : enumerate(code.instructions)) {
+			if (instruction.type == opcode::store_delay || instruction.type == opcode::delay_line) {
+				mark(i);
+			}
+		}
+	}
+	while (!pending.empty()) {
+		auto const& instruction = code.instructions[pending.back()];
+		pending.pop_back();
+		for (auto const operand : instruction.operands) {
+			use(operand);
+		}
+		if (instruction.type == opcode::delay) {
+			// A delay that is read has to be updated as well, which makes its input part of the cone.
+			mark(stores[instruction.index]);
+		} else if (instruction.type == opcode::custom || instruction.type == opcode::custom_quantize) {
+			for (auto const input : code.custom_calls[instruction.index].inputs) {
+				use(input);
+			}
+		}
+	}
+
+	auto cone = program{};
+	cone.constants = code.constants;
+	cone.delays = code.delays;
+	cone.formats = code.formats;
+	cone.custom_calls = code.custom_calls;
+	cone.result_keys = code.result_keys;
+	auto slots = std::vector<slot_index>(code.slot_count, no_slot);
+	auto const renumber = [&](slot_index& slot) {
+		if (slot != no_slot) {
+			if (slots[slot] == no_slot) {
+				slots[slot] = cone.allocate_slot();
+			}
+			slot = slots[slot];
+		}
+	};
+	auto const lookup = [&](slot_index slot) {
+		return slot == no_slot ? no_slot : slots[slot];
+	};
+
+	auto called = std::vector<bool>(code.custom_calls.size(), false);
+	for (auto&& [i, instruction] : enumerate(code.instructions)) {
+		if (!live[i]) {
+			continue;
+		}
+		auto& copy = cone.instructions.emplace_back(instruction);
+		renumber(copy.result);
+		for (auto& operand : copy.operands) {
+			renumber(operand);
+		}
+		if (copy.type == opcode::delay_line) {
+			auto& line = cone.delay_lines.emplace_back(code.delay_lines[copy.index]);
+			line.source = copy.operands[0];
+			for (auto& tap : line.taps) {
+				renumber(tap);
+			}
+			copy.index = static_cast<std::uint32_t>(cone.delay_lines.size() - 1);
+		} else if (copy.type == opcode::custom || copy.type == opcode::custom_quantize) {
+			called[copy.index] = true;
+			for (auto& input : cone.custom_calls[copy.index].inputs) {
+				renumber(input);
+			}
+		}
+	}
+	cone.output_slots.reserve(outputs.size());
+	for (auto const output : outputs) {
+		renumber(cone.output_slots.emplace_back(code.output_slots[output]));
+	}
+	// Live results may be inputs, which no instruction produces.
+	for (auto const result : live_results) {
+		auto slot = code.result_slots[result];
+		renumber(slot);
+	}
+	// Calls that are no longer made are only kept to leave the indices of the others unchanged.
+	for (auto&& [i, call] : enumerate(cone.custom_calls)) {
+		if (!called[i]) {
+			for (auto& input : call.inputs) {
+				input = lookup(input);
+			}
+		}
+	}
+	cone.input_slots.reserve(code.input_slots.size());
+	for (auto const slot : code.input_slots) {
+		cone.input_slots.push_back(lookup(slot));
+	}
+	cone.result_slots.reserve(code.result_slots.size());
+	for (auto const slot : code.result_slots) {
+		cone.result_slots.push_back(lookup(slot));
+	}
+
+	schedule(cone);
+	ASIC_DEBUG_MSG("Selected the cone of the simulation outputs.");
+	return cone;
+}
+
+} // namespace asic
@@ -0,0 +1,20 @@
+#ifndef ASIC_SIMULATION_OUTPUT_CONE_HPP
+#define ASIC_SIMULATION_OUTPUT_CONE_HPP
+
+#include "../span.hpp"
+#include "instruction.hpp"
+
+#include <cstddef>
+
+namespace asic {
+
+// Make a scheduled program that only evaluates the given outputs and live results of a scheduled program, together with the delays
+// they depend on and the inputs of those delays. The other delays keep their values, unless advance_delays is set, in which case
+// every delay is updated as usual. Delay registers are shared with the original program, so the same state can be run by either,
+// while the slots are renumbered and unused inputs get no slot. Values have to be laid out again afterwards.
+[[nodiscard]] program output_cone(program const& code, span<std::size_t const> outputs, span<std::size_t const> live_results,
+								  bool advance_delays);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_OUTPUT_CONE_HPP
@@ -0,0 +1,39 @@
+#ifndef ASIC_SIMULATION_PHILOX_HPP
+#define ASIC_SIMULATION_PHILOX_HPP
+
+#include <array>
+#include <cstdint>
+
+namespace asic {
+
+// The Philox4x32-10 counter-based random number generator (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3", 2011),
+// which maps each counter to random bits independently of all other counters.
+[[nodiscard]] constexpr std::array<std::uint32_t, 4> philox4x32(std::array<std::uint32_t, 4> counter,
+																std::array<std::uint32_t, 2> key) noexcept {
+	constexpr auto multipliers = std::array<std::uint64_t, 2>{0xD2511F53, 0xCD9E8D57};
+	constexpr auto weyl = std::array<std::uint32_t, 2>{0x9E3779B9, 0xBB67AE85};
+	for (auto round = 0; round < 10; ++round) {
+		auto const p0 = multipliers[0] * counter[0];
+		auto const p1 = multipliers[1] * counter[2];
+		counter = {static_cast<std::uint32_t>(p1 >> 32) ^ counter[1] ^ key[0], static_cast<std::uint32_t>(p1),
+				   static_cast<std::uint32_t>(p0 >> 32) ^ counter[3] ^ key[1], static_cast<std::uint32_t>(p0)};
+		key = {key[0] + weyl[0], key[1] + weyl[1]};
+	}
+	return counter;
+}
+
+// Two uniformly distributed values in [0, 1) that only depend on the arguments, matching _counter_uniforms in
+// b_asic.signal_generator.
+[[nodiscard]] constexpr std::array<double, 2> counter_uniforms(std::uint64_t seed, std::uint64_t stream, std::uint64_t time) noexcept {
+	auto const words = philox4x32({static_cast<std::uint32_t>(time), static_cast<std::uint32_t>(time >> 32),
+								   static_cast<std::uint32_t>(stream), static_cast<std::uint32_t>(stream >> 32)},
+								  {static_cast<std::uint32_t>(seed), static_cast<std::uint32_t>(seed >> 32)});
+	auto const first = (std::uint64_t{words[1]} << 32) | words[0];
+	auto const second = (std::uint64_t{words[3]} << 32) | words[2];
+	constexpr auto scale = 1.0 / static_cast<double>(std::uint64_t{1} << 53);
+	return {static_cast<double>(first >> 11) * scale, static_cast<double>(second >> 11) * scale};
+}
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_PHILOX_HPP
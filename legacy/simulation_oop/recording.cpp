@@ -0,0 +1,271 @@
+#include "recording.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+
+#include <algorithm>
+#include <filesystem>
+#include <fmt/format.h>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+namespace asic {
+
+namespace {
+
+template <typename T>
+[[nodiscard]] real_number real_part(T value) noexcept {
+	if constexpr (std::is_same_v<T, number>) {
+		return value.real();
+	} else {
+		return value;
+	}
+}
+
+// Write one iteration into a ring buffer that holds every iteration twice, length iterations apart, so that the last length
+// iterations are always stored contiguously.
+template <typename T>
+void write_ring(std::vector<T>& ring, std::size_t length, std::size_t head, std::size_t lanes, T const* source) {
+	std::copy_n(source, lanes, ring.data() + head * lanes);
+	std::copy_n(source, lanes, ring.data() + (head + length) * lanes);
+}
+
+// The .npy type descriptions of the sample types, assuming a little-endian machine.
+template <typename T>
+constexpr auto npy_descr = std::is_same_v<T, number> ? "<c16" : "<f8";
+
+template <typename T>
+void reserve_buffer(result_buffer<T>& buffer, std::size_t capacity) {
+	if (buffer.use_count() > 1) {
+		// Arrays returned by results() still refer to this buffer, so continue in a copy to keep them valid.
+		auto copy = std::make_shared<std::vector<T>>();
+		copy->reserve(std::max(capacity, buffer->size()));
+		copy->assign(buffer->begin(), buffer->end());
+		buffer = std::move(copy);
+	} else {
+		buffer->reserve(capacity);
+	}
+}
+
+} // namespace
+
+template <typename T>
+recorder<T>::recorder(recording_policy policy, std::size_t probe_count, std::size_t lanes)
+	: m_policy(std::move(policy))
+	, m_probe_count(probe_count)
+	, m_lanes(lanes) {}
+
+template <typename T>
+template <typename U>
+recorder<U> recorder<T>::converted() const {
+	auto result = recorder<U>{m_policy, m_probe_count, m_lanes};
+	for (auto const& buffer : m_buffers) {
+		auto& values = *result.m_buffers.emplace_back(std::make_shared<std::vector<U>>());
+		values.reserve(buffer->capacity());
+		values.assign(buffer->begin(), buffer->end());
+	}
+	for (auto const& history : m_history) {
+		result.m_history.emplace_back(history.begin(), history.end());
+	}
+	result.m_head = m_head;
+	result.m_size = m_size;
+	result.m_previous = m_previous;
+	result.m_trigger_iteration = m_trigger_iteration;
+	result.m_remaining = m_remaining;
+	return result;
+}
+
+template <typename T>
+bool recorder<T>::empty() const noexcept {
+	return m_buffers.empty();
+}
+
+template <typename T>
+std::optional<iteration_type> recorder<T>::trigger_iteration() const noexcept {
+	return m_trigger_iteration;
+}
+
+template <typename T>
+recorded_values<T> recorder<T>::values(std::size_t probe) const {
+	auto const& buffer = m_buffers.at(probe);
+	if (m_policy.mode == recording_mode::ring) {
+		return recorded_values<T>{buffer, (m_head + m_policy.length - m_size) * m_lanes, m_size * m_lanes};
+	}
+	return recorded_values<T>{buffer, 0, buffer->size()};
+}
+
+template <typename T>
+void recorder<T>::reserve(std::size_t iterations) {
+	if (m_buffers.empty()) {
+		auto const ring_size = (m_policy.mode == recording_mode::ring) ? 2 * m_policy.length * m_lanes : 0;
+		std::generate_n(std::back_inserter(m_buffers), m_probe_count, [&] { return std::make_shared<std::vector<T>>(ring_size); });
+		if (m_policy.mode == recording_mode::trigger) {
+			m_history.assign(m_probe_count, std::vector<T>(2 * m_policy.before * m_lanes));
+		}
+	}
+	for (auto& buffer : m_buffers) {
+		switch (m_policy.mode) {
+			case recording_mode::full:
+				reserve_buffer(buffer, buffer->size() + iterations * m_lanes);
+				break;
+			case recording_mode::ring:
+				reserve_buffer(buffer, buffer->size());
+				break;
+			case recording_mode::decimate:
+				reserve_buffer(buffer, buffer->size() + (iterations / m_policy.factor + 1) * m_lanes);
+				break;
+			case recording_mode::trigger:
+				reserve_buffer(buffer, (m_policy.before + m_policy.after) * m_lanes);
+				break;
+		}
+	}
+}
+
+template <typename T>
+void recorder<T>::record(iteration_type first_iteration, std::size_t count, span<T const> values, span<std::size_t const> offsets,
+						 std::optional<std::size_t> trigger_offset) {
+	ASIC_ASSERT(offsets.size() == m_buffers.size());
+	switch (m_policy.mode) {
+		case recording_mode::full:
+			for (auto&& [buffer, offset] : zip(m_buffers, offsets)) {
+				auto const* const block = values.data() + offset;
+				buffer->insert(buffer->end(), block, block + count * m_lanes);
+			}
+			break;
+		case recording_mode::ring:
+			// Older iterations of the block would be overwritten anyway.
+			for (auto n = count - std::min(count, m_policy.length); n < count; ++n) {
+				this->record_iteration(n, values, offsets);
+			}
+			break;
+		case recording_mode::decimate:
+			for (auto n = (m_policy.factor - first_iteration % m_policy.factor) % m_policy.factor; n < count; n += m_policy.factor) {
+				this->record_iteration(n, values, offsets);
+			}
+			break;
+		case recording_mode::trigger:
+			ASIC_ASSERT(trigger_offset);
+			for (auto const n : range(count)) {
+				if (m_remaining > 0) {
+					this->record_iteration(n, values, offsets);
+					--m_remaining;
+					continue;
+				}
+				if (m_trigger_iteration) {
+					break;
+				}
+				// Only the first lane is used to detect the trigger.
+				auto const current = real_part(values[*trigger_offset + n * m_lanes]);
+				if (m_previous && *m_previous < m_policy.level && current >= m_policy.level) {
+					m_trigger_iteration = first_iteration + static_cast<iteration_type>(n);
+					for (auto&& [buffer, history] : zip(m_buffers, m_history)) {
+						auto const begin = history.begin() + static_cast<std::ptrdiff_t>((m_head + m_policy.before - m_size) * m_lanes);
+						buffer->insert(buffer->end(), begin, begin + static_cast<std::ptrdiff_t>(m_size * m_lanes));
+					}
+					m_history.clear();
+					this->record_iteration(n, values, offsets);
+					m_remaining = m_policy.after - 1;
+				} else {
+					this->push_history(n, values, offsets);
+				}
+				m_previous = current;
+			}
+			break;
+	}
+}
+
+template <typename T>
+void recorder<T>::record_iteration(std::size_t n, span<T const> values, span<std::size_t const> offsets) {
+	if (m_policy.mode == recording_mode::ring) {
+		for (auto&& [buffer, offset] : zip(m_buffers, offsets)) {
+			write_ring(*buffer, m_policy.length, m_head, m_lanes, values.data() + offset + n * m_lanes);
+		}
+		m_head = (m_head + 1) % m_policy.length;
+		m_size = std::min(m_size + 1, m_policy.length);
+		return;
+	}
+	for (auto&& [buffer, offset] : zip(m_buffers, offsets)) {
+		auto const* const sample = values.data() + offset + n * m_lanes;
+		buffer->insert(buffer->end(), sample, sample + m_lanes);
+	}
+}
+
+template <typename T>
+void recorder<T>::push_history(std::size_t n, span<T const> values, span<std::size_t const> offsets) {
+	if (m_policy.before == 0) {
+		return;
+	}
+	for (auto&& [history, offset] : zip(m_history, offsets)) {
+		write_ring(history, m_policy.before, m_head, m_lanes, values.data() + offset + n * m_lanes);
+	}
+	m_head = (m_head + 1) % m_policy.before;
+	m_size = std::min(m_size + 1, m_policy.before);
+}
+
+template <typename T>
+void recorder<T>::clear() noexcept {
+	m_buffers.clear();
+	m_history.clear();
+	m_head = 0;
+	m_size = 0;
+	m_previous.reset();
+	m_trigger_iteration.reset();
+	m_remaining = 0;
+}
+
+template <typename T>
+result_stream<T>::result_stream(std::string const& path, std::vector<result_key> const& keys, std::size_t iterations, std::size_t lanes,
+								bool combined)
+	: m_probe_count(keys.size())
+	, m_lanes(lanes)
+	, m_capacity(iterations)
+	, m_combined(combined) {
+	// Lanes and probes vary fastest in memory, so each block is written to a contiguous range of iterations. Fortran order gives the
+	// same shapes as the saved results.
+	if (m_combined) {
+		auto shape = (m_lanes == 1) ? std::vector<std::size_t>{m_probe_count, m_capacity}
+									: std::vector<std::size_t>{m_probe_count, m_lanes, m_capacity};
+		m_files.emplace_back(path, npy_descr<T>, shape, true, sizeof(T));
+		return;
+	}
+	std::filesystem::create_directories(path);
+	auto const shape = (m_lanes == 1) ? std::vector<std::size_t>{m_capacity} : std::vector<std::size_t>{m_lanes, m_capacity};
+	for (auto const& key : keys) {
+		m_files.emplace_back(fmt::format("{}/{}.npy", path, key), npy_descr<T>, shape, true, sizeof(T));
+	}
+}
+
+template <typename T>
+std::size_t result_stream<T>::written() const noexcept {
+	return m_position;
+}
+
+template <typename T>
+void result_stream<T>::record(std::size_t count, span<T const> values, span<std::size_t const> offsets) {
+	ASIC_ASSERT(offsets.size() == m_probe_count);
+	auto const size = std::min(count, m_capacity - m_position) * m_lanes;
+	if (m_combined) {
+		auto* const data = static_cast<T*>(m_files.front().data()) + m_position * m_lanes * m_probe_count;
+		for (auto&& [probe, offset] : enumerate(offsets)) {
+			auto const* const block = values.data() + offset;
+			for (auto const i : range(size)) {
+				data[i * m_probe_count + probe] = block[i];
+			}
+		}
+	} else {
+		for (auto&& [file, offset] : zip(m_files, offsets)) {
+			auto const* const block = values.data() + offset;
+			std::copy(block, block + size, static_cast<T*>(file.data()) + m_position * m_lanes);
+		}
+	}
+	m_position += size / m_lanes;
+}
+
+template class recorder<real_number>;
+template class recorder<number>;
+template recorder<number> recorder<real_number>::converted<number>() const;
+template class result_stream<real_number>;
+template class result_stream<number>;
+
+} // namespace asic
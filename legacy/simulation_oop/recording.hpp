@@ -0,0 +1,112 @@
+#ifndef ASIC_SIMULATION_RECORDING_HPP
+#define ASIC_SIMULATION_RECORDING_HPP
+
+#include "../span.hpp"
+#include "instruction.hpp"
+#include "npy_file.hpp"
+#include "run.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace asic {
+
+enum class recording_mode : std::uint8_t {
+	full,     // Every iteration.
+	ring,     // The last length iterations.
+	decimate, // Every iteration that is a multiple of factor.
+	trigger,  // The before iterations preceding the first rising crossing of level by the trigger result, and after iterations from it.
+};
+
+struct recording_policy final {
+	recording_mode mode = recording_mode::full;
+	std::size_t length = 0;
+	std::size_t factor = 1;
+	result_key trigger_key{};
+	real_number level = 0;
+	std::size_t before = 0;
+	std::size_t after = 0;
+};
+
+// Saved results are shared with the NumPy arrays returned by simulation::results, so that no copy is made on access.
+template <typename T>
+using result_buffer = std::shared_ptr<std::vector<T>>;
+
+template <typename T>
+struct recorded_values final {
+	result_buffer<T> buffer;
+	std::size_t offset = 0;
+	std::size_t size = 0;
+};
+
+// Records the values of a number of probes according to a recording policy. The memory used by all policies except full and
+// decimate is bounded by the policy, no matter how many iterations are recorded.
+template <typename T>
+class recorder final {
+public:
+	recorder() = default;
+	recorder(recording_policy policy, std::size_t probe_count, std::size_t lanes);
+
+	template <typename U>
+	friend class recorder;
+
+	template <typename U>
+	[[nodiscard]] recorder<U> converted() const;
+
+	[[nodiscard]] bool empty() const noexcept;
+	[[nodiscard]] std::optional<iteration_type> trigger_iteration() const noexcept;
+	[[nodiscard]] recorded_values<T> values(std::size_t probe) const;
+
+	// Make room for the given number of iterations without touching buffers that are shared with exported arrays.
+	void reserve(std::size_t iterations);
+
+	// Record count iterations starting at first_iteration from blocks of values starting at the given offsets, as laid out by
+	// layout_values. The trigger offset is only used by the trigger policy.
+	void record(iteration_type first_iteration, std::size_t count, span<T const> values, span<std::size_t const> offsets,
+				std::optional<std::size_t> trigger_offset);
+
+	void clear() noexcept;
+
+private:
+	void record_iteration(std::size_t n, span<T const> values, span<std::size_t const> offsets);
+	void push_history(std::size_t n, span<T const> values, span<std::size_t const> offsets);
+
+	recording_policy m_policy{};
+	std::size_t m_probe_count = 0;
+	std::size_t m_lanes = 1;
+	std::vector<result_buffer<T>> m_buffers{};
+	std::vector<std::vector<T>> m_history{}; // Iterations preceding the trigger, stored twice to always be contiguous.
+	std::size_t m_head = 0;                  // Next position in the ring buffers or the trigger history.
+	std::size_t m_size = 0;                  // Number of valid iterations in the ring buffers or the trigger history.
+	std::optional<real_number> m_previous{};
+	std::optional<iteration_type> m_trigger_iteration{};
+	std::size_t m_remaining = 0;
+};
+
+// Writes the values of a number of probes into preallocated, memory-mapped .npy files as they are computed, either one file per
+// probe or a single file holding all of them. Iterations beyond the preallocated length are not written.
+template <typename T>
+class result_stream final {
+public:
+	result_stream(std::string const& path, std::vector<result_key> const& keys, std::size_t iterations, std::size_t lanes, bool combined);
+
+	[[nodiscard]] std::size_t written() const noexcept;
+
+	void record(std::size_t count, span<T const> values, span<std::size_t const> offsets);
+
+private:
+	std::vector<npy_file> m_files{};
+	std::size_t m_probe_count;
+	std::size_t m_lanes;
+	std::size_t m_capacity;
+	std::size_t m_position = 0;
+	bool m_combined;
+};
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_RECORDING_HPP
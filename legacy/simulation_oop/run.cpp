@@ -0,0 +1,392 @@
+#include "run.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+#include "custom_operation.hpp"
+
+#define NOMINMAX
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fmt/format.h>
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <stdexcept>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace asic {
+
+namespace {
+
+template <typename T>
+[[nodiscard]] real_number real_value(T value, char const* name) {
+	if constexpr (std::is_same_v<T, number>) {
+		if (value.imag() != 0) {
+			throw std::runtime_error{fmt::format("{} does not support complex numbers.", name)};
+		}
+		return value.real();
+	} else {
+		return value;
+	}
+}
+
+template <typename T>
+[[nodiscard]] T quantize_value(T value, std::size_t bits, std::size_t index) {
+	if constexpr (std::is_same_v<T, number>) {
+		if (value.imag() != 0) {
+			throw py::type_error{fmt::format(
+				"Complex value cannot be quantized to {} bits as requested by the signal connected to input #{}", bits, index)};
+		}
+	}
+	auto const real = real_value(value, "Quantization");
+	return T{static_cast<real_number>(static_cast<std::int64_t>(real) & ((std::int64_t{1} << bits) - 1))};
+}
+
+// Matches b_asic.quantization.quantize bit for bit, but rounds and wraps the scaled value as an integer.
+[[nodiscard]] real_number quantize_fixed_point(real_number value, fixed_point_format const& format) {
+	auto const scaled = std::ldexp(value, format.fractional_bits);
+	auto rounded = real_number{};
+	auto jam = false;
+	switch (format.quantization) {
+		case quantization_mode::rounding:
+			rounded = std::floor(scaled + 0.5);
+			break;
+		case quantization_mode::truncation:
+			rounded = std::floor(scaled);
+			break;
+		case quantization_mode::magnitude_truncation:
+			rounded = std::trunc(scaled);
+			break;
+		case quantization_mode::jamming:
+			rounded = std::floor(scaled);
+			jam = true;
+			break;
+		case quantization_mode::unbiased_rounding:
+			rounded = std::nearbyint(scaled);
+			break;
+		case quantization_mode::unbiased_jamming:
+			rounded = std::floor(scaled);
+			jam = rounded != scaled;
+			break;
+	}
+	if (!std::isfinite(rounded)) {
+		throw std::runtime_error{"Cannot quantize a value that is not finite."};
+	}
+
+	auto const word_length = format.integer_bits + format.fractional_bits;
+	auto const limit = std::int64_t{1} << (word_length - 1);
+	auto result = std::int64_t{};
+	if (format.overflow == overflow_mode::saturation) {
+		// Clamp to a range that still holds the bounds after jamming so that the conversion cannot overflow.
+		result = static_cast<std::int64_t>(std::clamp(rounded, -static_cast<real_number>(limit) - 2, static_cast<real_number>(limit) + 1));
+		if (jam) {
+			result |= 1;
+		}
+		result = std::clamp(result, -limit, limit - 1);
+	} else {
+		// Reducing the value modulo the word range first is exact and keeps the lowest bit for jamming.
+		result = static_cast<std::int64_t>(std::fmod(rounded, static_cast<real_number>(2 * limit)));
+		if (jam) {
+			result |= 1;
+		}
+		result = (result + limit) % (2 * limit);
+		if (result < 0) {
+			result += 2 * limit;
+		}
+		result -= limit;
+	}
+	return std::ldexp(static_cast<real_number>(result), -format.fractional_bits);
+}
+
+template <typename T>
+[[nodiscard]] T conjugate(T value) {
+	if constexpr (std::is_same_v<T, number>) {
+		return std::conj(value);
+	} else {
+		return value;
+	}
+}
+
+template <typename T>
+void execute(program const& code, instruction const& instruction, span<T> values, span<T> delays, std::size_t lanes, std::size_t begin,
+			 std::size_t end) {
+	auto const slot = [&](slot_index index) {
+		return values.data() + code.slot_offsets[index];
+	};
+	auto* const result = (instruction.result == no_slot) ? nullptr : slot(instruction.result);
+	auto const* const a = (instruction.operands[0] == no_slot) ? nullptr : slot(instruction.operands[0]);
+	auto const* const b = (instruction.operands[1] == no_slot) ? nullptr : slot(instruction.operands[1]);
+	auto const* const c = (instruction.operands[2] == no_slot) ? nullptr : slot(instruction.operands[2]);
+	switch (instruction.type) {
+		case opcode::constant:
+			std::fill(result + begin, result + end, sample_cast<T>(code.constants[instruction.index]));
+			break;
+		case opcode::delay: {
+			auto const* const reg = delays.data() + static_cast<std::size_t>(instruction.index) * lanes;
+			for (auto n = begin; n < end; ++n) {
+				result[n] = (n < lanes) ? reg[n] : a[n - lanes];
+			}
+			break;
+		}
+		case opcode::store_delay:
+			std::copy(a + end - lanes, a + end, delays.data() + static_cast<std::size_t>(instruction.index) * lanes);
+			break;
+		case opcode::delay_line:
+			// The current block of the source follows the output of the first delay, which starts one iteration earlier.
+			std::copy(a + begin, a + end, slot(code.delay_lines[instruction.index].taps.front()) + lanes + begin);
+			break;
+		case opcode::quantize:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = quantize_value(a[n], instruction.bits, instruction.index);
+			}
+			break;
+		case opcode::fixed_point_quantize: {
+			auto const& format = code.formats[instruction.index];
+			for (auto n = begin; n < end; ++n) {
+				if constexpr (std::is_same_v<T, number>) {
+					result[n] = T{quantize_fixed_point(a[n].real(), format), quantize_fixed_point(a[n].imag(), format)};
+				} else {
+					result[n] = quantize_fixed_point(a[n], format);
+				}
+			}
+			break;
+		}
+		case opcode::custom_quantize: {
+			auto const& call = code.custom_calls[instruction.index];
+			for (auto n = begin; n < end; ++n) {
+				result[n] = sample_cast<T>(call.op->quantize(call.index, number{a[n]}, instruction.bits));
+			}
+			break;
+		}
+		case opcode::addition:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] + b[n];
+			}
+			break;
+		case opcode::subtraction:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] - b[n];
+			}
+			break;
+		case opcode::multiplication:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] * b[n];
+			}
+			break;
+		case opcode::division:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] / b[n];
+			}
+			break;
+		case opcode::min:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = std::min(real_value(a[n], "Min"), real_value(b[n], "Min"));
+			}
+			break;
+		case opcode::max:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = std::max(real_value(a[n], "Max"), real_value(b[n], "Max"));
+			}
+			break;
+		case opcode::square_root:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = std::sqrt(a[n]);
+			}
+			break;
+		case opcode::complex_conjugate:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = conjugate(a[n]);
+			}
+			break;
+		case opcode::absolute:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = std::abs(a[n]);
+			}
+			break;
+		case opcode::constant_multiplication: {
+			auto const value = sample_cast<T>(code.constants[instruction.index]);
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] * value;
+			}
+			break;
+		}
+		case opcode::multiply_add:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = a[n] * b[n] + c[n];
+			}
+			break;
+		case opcode::symmetric_twoport_adaptor: {
+			auto const value = sample_cast<T>(code.constants[instruction.index]);
+			for (auto n = begin; n < end; ++n) {
+				result[n] = c[n] + value * (b[n] - a[n]);
+			}
+			break;
+		}
+		case opcode::reciprocal:
+			for (auto n = begin; n < end; ++n) {
+				result[n] = T{1} / a[n];
+			}
+			break;
+		case opcode::custom: {
+			auto const& call = code.custom_calls[instruction.index];
+			if (call.op->has_block_evaluation() && end - begin > 1) {
+				// Several samples (or lanes) are independent here, so hand them all to Python in one call.
+				auto const sample_count = end - begin;
+				auto input_values = py::array_t<number>(
+					std::vector<py::ssize_t>{static_cast<py::ssize_t>(call.inputs.size()), static_cast<py::ssize_t>(sample_count)});
+				auto* const data = input_values.mutable_data();
+				for (auto&& [i, input] : enumerate(call.inputs)) {
+					std::copy(slot(input) + begin, slot(input) + end, data + i * sample_count);
+				}
+				auto const output_values = call.op->evaluate_block(call.index, std::move(input_values));
+				std::transform(output_values.data(), output_values.data() + sample_count, result + begin, sample_cast<T>);
+				break;
+			}
+			auto input_values = std::vector<number>(call.inputs.size());
+			for (auto n = begin; n < end; ++n) {
+				for (auto&& [value, input] : zip(input_values, call.inputs)) {
+					value = number{slot(input)[n]};
+				}
+				result[n] = sample_cast<T>(call.op->evaluate(call.index, input_values));
+			}
+			break;
+		}
+	}
+}
+
+} // namespace
+
+bool supports_real_samples(program const& code) {
+	auto const is_real = [](number value) {
+		return value.imag() == 0;
+	};
+	if (!std::all_of(code.constants.begin(), code.constants.end(), is_real)) {
+		return false;
+	}
+	if (!std::all_of(code.delays.begin(), code.delays.end(), [&](delay_register const& reg) { return is_real(reg.initial_value); })) {
+		return false;
+	}
+	// Square roots of negative values and Python operations may produce complex values from real inputs.
+	return std::none_of(code.instructions.begin(), code.instructions.end(), [](instruction const& instruction) {
+		return instruction.type == opcode::square_root || instruction.type == opcode::custom || instruction.type == opcode::custom_quantize;
+	});
+}
+
+std::optional<number> evaluate_constant(program const& code, instruction const& instruction, std::array<number, 3> operands) {
+	auto const [a, b, c] = operands;
+	try {
+		switch (instruction.type) {
+			case opcode::quantize:
+				return quantize_value(a, instruction.bits, instruction.index);
+			case opcode::fixed_point_quantize: {
+				auto const& format = code.formats[instruction.index];
+				return number{quantize_fixed_point(a.real(), format), quantize_fixed_point(a.imag(), format)};
+			}
+			case opcode::addition:
+				return a + b;
+			case opcode::subtraction:
+				return a - b;
+			case opcode::multiplication:
+				return a * b;
+			case opcode::division:
+				return a / b;
+			case opcode::min:
+				return number{std::min(real_value(a, "Min"), real_value(b, "Min"))};
+			case opcode::max:
+				return number{std::max(real_value(a, "Max"), real_value(b, "Max"))};
+			case opcode::square_root:
+				return std::sqrt(a);
+			case opcode::complex_conjugate:
+				return conjugate(a);
+			case opcode::absolute:
+				return number{std::abs(a)};
+			case opcode::constant_multiplication:
+				return a * code.constants[instruction.index];
+			case opcode::multiply_add:
+				return a * b + c;
+			case opcode::symmetric_twoport_adaptor:
+				return c + code.constants[instruction.index] * (b - a);
+			case opcode::reciprocal:
+				return number{1} / a;
+			default:
+				return std::nullopt;
+		}
+	} catch (std::exception const&) {
+		// Left for the run to report.
+		return std::nullopt;
+	}
+}
+
+bool requires_python(program const& code) {
+	return std::any_of(code.instructions.begin(), code.instructions.end(), [](instruction const& instruction) {
+		return instruction.type == opcode::custom || instruction.type == opcode::custom_quantize;
+	});
+}
+
+bool calls_python_per_iteration(program const& code) {
+	return std::any_of(code.instructions.begin(), code.instructions.end(), [&](instruction const& instruction) {
+		return instruction.type == opcode::custom && !code.custom_calls[instruction.index].op->has_block_evaluation();
+	});
+}
+
+void layout_values(program& code, std::size_t block_size, std::size_t lanes) {
+	auto const stride = block_size * lanes;
+	code.slot_offsets.assign(code.slot_count, 0);
+	auto taps = std::vector<bool>(code.slot_count, false);
+	for (auto const& line : code.delay_lines) {
+		for (auto const tap : line.taps) {
+			taps[tap] = true;
+		}
+	}
+	auto offset = std::size_t{0};
+	for (auto const slot : range(code.slot_count)) {
+		if (!taps[slot]) {
+			code.slot_offsets[slot] = offset;
+			offset += stride;
+		}
+	}
+	for (auto const& line : code.delay_lines) {
+		// The previous values are stored before the current block, so the k:th delay starts k iterations before it.
+		for (auto&& [k, tap] : enumerate(line.taps)) {
+			code.slot_offsets[tap] = offset + (line.taps.size() - k - 1) * lanes;
+		}
+		offset += line.taps.size() * lanes + stride;
+	}
+	code.value_count = offset;
+}
+
+template <typename T>
+void run_program(program const& code, span<T> values, span<T> delays, std::size_t block_size, std::size_t lanes, std::size_t count) {
+	ASIC_ASSERT(values.size() == code.value_count);
+	ASIC_ASSERT(delays.size() == code.delays.size() * lanes);
+	ASIC_ASSERT(count > 0 && count <= block_size);
+	for (auto const& line : code.delay_lines) {
+		std::copy_n(delays.data() + line.first_register * lanes, line.taps.size() * lanes, values.data() + code.slot_offsets[line.taps.back()]);
+	}
+	for (auto const& segment : code.segments) {
+		if (segment.recurrent) {
+			// Only the lanes are independent here, so this is the innermost loop of every kernel.
+			for (auto const n : range(count)) {
+				for (auto const i : range(segment.begin, segment.end)) {
+					execute(code, code.instructions[i], values, delays, lanes, n * lanes, (n + 1) * lanes);
+				}
+			}
+		} else {
+			for (auto const i : range(segment.begin, segment.end)) {
+				execute(code, code.instructions[i], values, delays, lanes, 0, count * lanes);
+			}
+		}
+	}
+	// The last values of the sources become the previous values of the next block.
+	for (auto const& line : code.delay_lines) {
+		std::copy_n(values.data() + code.slot_offsets[line.taps.back()] + count * lanes, line.taps.size() * lanes,
+					delays.data() + line.first_register * lanes);
+	}
+}
+
+template void run_program<real_number>(program const&, span<real_number>, span<real_number>, std::size_t, std::size_t, std::size_t);
+template void run_program<number>(program const&, span<number>, span<number>, std::size_t, std::size_t, std::size_t);
+
+} // namespace asic
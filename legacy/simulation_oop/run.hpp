@@ -0,0 +1,53 @@
+#ifndef ASIC_SIMULATION_RUN_HPP
+#define ASIC_SIMULATION_RUN_HPP
+
+#include "../number.hpp"
+#include "../span.hpp"
+#include "instruction.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+
+namespace asic {
+
+using real_number = number::value_type;
+using iteration_type = std::uint32_t;
+
+template <typename T>
+[[nodiscard]] T sample_cast(number value) noexcept {
+	if constexpr (std::is_same_v<T, number>) {
+		return value;
+	} else {
+		return value.real();
+	}
+}
+
+// Check if the program can be run using real samples, given that all of its inputs are real.
+[[nodiscard]] bool supports_real_samples(program const& code);
+
+[[nodiscard]] bool requires_python(program const& code);
+
+// Check if the program has a Python operation without evaluate_output_block. The program is then evaluated one iteration at a
+// time in the order of the graph, so that Python operations sharing state are called in the same order as by b_asic.Simulation.
+[[nodiscard]] bool calls_python_per_iteration(program const& code);
+
+// Evaluate an instruction that only depends on its operands, like at run time with complex samples. Returns nothing for
+// instructions with state or Python calls, and for operands that would make the instruction fail.
+[[nodiscard]] std::optional<number> evaluate_constant(program const& code, instruction const& instruction, std::array<number, 3> operands);
+
+// Assign each slot an offset in the values, giving room for block_size iterations of the given number of lanes. The slots of a
+// delay line share the buffer of the line.
+void layout_values(program& code, std::size_t block_size, std::size_t lanes);
+
+// Evaluate the first count iterations of a block. Each slot holds block_size iterations of the given number of independent lanes,
+// stored consecutively with the lanes of each iteration next to each other, at the offset given by layout_values. Each delay
+// register holds one value per lane.
+template <typename T>
+void run_program(program const& code, span<T> values, span<T> delays, std::size_t block_size, std::size_t lanes, std::size_t count);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_RUN_HPP
@@ -0,0 +1,155 @@
+#include "schedule.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+#include "run.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace asic {
+
+namespace {
+
+constexpr auto no_instruction = std::numeric_limits<std::size_t>::max();
+
+using dependency_list = std::vector<std::vector<std::size_t>>;
+
+[[nodiscard]] dependency_list find_dependencies(program const& code) {
+	auto producers = std::vector<std::size_t>(code.slot_count, no_instruction);
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.result != no_slot) {
+			producers[instruction.result] = i;
+		}
+		if (instruction.type == opcode::delay_line) {
+			for (auto const tap : code.delay_lines[instruction.index].taps) {
+				producers[tap] = i;
+			}
+		}
+	}
+	auto dependencies = dependency_list(code.instructions.size());
+	auto const add_dependency = [&](std::size_t i, slot_index slot) {
+		if (slot != no_slot && producers[slot] != no_instruction) {
+			dependencies[i].push_back(producers[slot]);
+		}
+	};
+	for (auto const& [i, instruction] : enumerate(code.instructions)) {
+		if (instruction.type == opcode::store_delay) {
+			continue;
+		}
+		for (auto const operand : instruction.operands) {
+			add_dependency(i, operand);
+		}
+		if (instruction.type == opcode::custom) {
+			for (auto const input : code.custom_calls[instruction.index].inputs) {
+				add_dependency(i, input);
+			}
+		}
+	}
+	return dependencies;
+}
+
+// Tarjan's algorithm, which yields the strongly connected components with all dependencies of a component before it.
+[[nodiscard]] std::vector<std::vector<std::size_t>> find_components(dependency_list const& dependencies) {
+	auto const count = dependencies.size();
+	auto components = std::vector<std::vector<std::size_t>>{};
+	auto order = std::vector<std::size_t>(count, no_instruction);
+	auto lowlink = std::vector<std::size_t>(count, 0);
+	auto on_stack = std::vector<bool>(count, false);
+	auto stack = std::vector<std::size_t>{};
+	auto call_stack = std::vector<std::pair<std::size_t, std::size_t>>{};
+	auto next_order = std::size_t{0};
+	for (auto const root : range(count)) {
+		if (order[root] != no_instruction) {
+			continue;
+		}
+		call_stack.emplace_back(root, 0);
+		while (!call_stack.empty()) {
+			auto& [node, next] = call_stack.back();
+			if (next == 0) {
+				order[node] = lowlink[node] = next_order++;
+				stack.push_back(node);
+				on_stack[node] = true;
+			}
+			if (next < dependencies[node].size()) {
+				auto const dependency = dependencies[node][next++];
+				if (order[dependency] == no_instruction) {
+					call_stack.emplace_back(dependency, 0);
+				} else if (on_stack[dependency]) {
+					lowlink[node] = std::min(lowlink[node], order[dependency]);
+				}
+				continue;
+			}
+			auto const finished = node;
+			call_stack.pop_back();
+			if (!call_stack.empty()) {
+				auto const parent = call_stack.back().first;
+				lowlink[parent] = std::min(lowlink[parent], lowlink[finished]);
+			}
+			if (lowlink[finished] == order[finished]) {
+				auto& component = components.emplace_back();
+				auto member = no_instruction;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					on_stack[member] = false;
+					component.push_back(member);
+				} while (member != finished);
+			}
+		}
+	}
+	return components;
+}
+
+} // namespace
+
+void schedule(program& code) {
+	auto const dependencies = find_dependencies(code);
+	auto instructions = std::vector<instruction>{};
+	instructions.reserve(code.instructions.size());
+	code.segments.clear();
+	auto const append = [&](instruction const& instruction, bool recurrent) {
+		if (code.segments.empty() || code.segments.back().recurrent != recurrent) {
+			code.segments.push_back(segment{instructions.size(), instructions.size(), recurrent});
+		}
+		instructions.push_back(instruction);
+		++code.segments.back().end;
+	};
+
+	if (calls_python_per_iteration(code)) {
+		// The original order is the order in which b_asic.Simulation evaluates the graph.
+		for (auto const& instruction : code.instructions) {
+			if (instruction.type != opcode::store_delay) {
+				append(instruction, true);
+			}
+		}
+	} else {
+		for (auto& component : find_components(dependencies)) {
+			auto const first = component.front();
+			if (code.instructions[first].type == opcode::store_delay) {
+				continue;
+			}
+			auto const recurrent = component.size() > 1 ||
+				std::find(dependencies[first].begin(), dependencies[first].end(), first) != dependencies[first].end();
+			// The original order satisfies all dependencies within one iteration, since delays only depend on earlier iterations.
+			std::sort(component.begin(), component.end());
+			for (auto const i : component) {
+				append(code.instructions[i], recurrent);
+			}
+		}
+	}
+
+	// Delay registers are updated once all instructions have been evaluated for the whole block.
+	for (auto const& instruction : code.instructions) {
+		if (instruction.type == opcode::store_delay) {
+			append(instruction, false);
+		}
+	}
+	ASIC_ASSERT(instructions.size() == code.instructions.size());
+	code.instructions = std::move(instructions);
+}
+
+} // namespace asic
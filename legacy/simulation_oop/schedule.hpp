@@ -0,0 +1,14 @@
+#ifndef ASIC_SIMULATION_SCHEDULE_HPP
+#define ASIC_SIMULATION_SCHEDULE_HPP
+
+#include "instruction.hpp"
+
+namespace asic {
+
+// Reorder the instructions into segments that can be evaluated over a block of iterations at a time. Instructions that take
+// part in feedback through delays are grouped into recurrent segments, which have to be evaluated one sample at a time.
+void schedule(program& code);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_SCHEDULE_HPP
@@ -6,24 +6,62 @@ namespace py = pybind11;
 
 namespace asic {
 
+namespace {
+
+// Signals carry a fixed-point format when Signal.fractional_bits is set. The parameters behind the other Signal properties of the
+// format are None until they are set, and default to the same values as b_asic.quantization.quantize.
+[[nodiscard]] std::optional<fixed_point_format> make_fixed_point_format(pybind11::handle signal) {
+	auto const param = [&](char const* name) {
+		return py::object{signal.attr("param")(name)};
+	};
+	auto const fractional_bits = param("fractional_bits");
+	if (fractional_bits.is_none()) {
+		return std::nullopt;
+	}
+	auto format = fixed_point_format{};
+	format.fractional_bits = fractional_bits.cast<int>();
+	if (auto const integer_bits = param("integer_bits"); !integer_bits.is_none()) {
+		format.integer_bits = integer_bits.cast<int>();
+	}
+	if (auto const quantization = param("quantization"); !quantization.is_none()) {
+		auto const value = quantization.attr("value").cast<int>();
+		if (value < 1 || value > 6) {
+			throw py::type_error{fmt::format("Unknown quantization method: {}", value)};
+		}
+		format.quantization = static_cast<quantization_mode>(value);
+	}
+	if (auto const overflow = param("overflow"); !overflow.is_none()) {
+		auto const value = overflow.attr("value").cast<int>();
+		if (value < 1 || value > 2) {
+			throw py::type_error{fmt::format("Unknown overflow method: {}", value)};
+		}
+		format.overflow = static_cast<overflow_mode>(value);
+	}
+	return format;
+}
+
+} // namespace
+
 signal_flow_graph_operation::signal_flow_graph_operation(result_key key)
 	: abstract_operation(std::move(key)) {}
 
-void signal_flow_graph_operation::create(pybind11::handle sfg, added_operation_cache& added) {
+void signal_flow_graph_operation::create(pybind11::handle sfg, graph_builder& builder) {
 	ASIC_DEBUG_MSG("Creating SFG.");
 	for (auto const& [i, op] : enumerate(sfg.attr("output_operations"))) {
 		ASIC_DEBUG_MSG("Adding output op.");
-		m_output_operations.emplace_back(this->key_of_output(i)).connect(make_source(op, 0, added, this->key_base()));
+		m_output_operations.emplace_back(this->key_of_output(i)).connect(make_source(op, 0, builder, this->key_base()));
 	}
 	for (auto const& op : sfg.attr("input_operations")) {
 		ASIC_DEBUG_MSG("Adding input op.");
-		if (!m_input_operations.emplace_back(std::dynamic_pointer_cast<input_operation>(make_operation(op, added, this->key_base())))) {
+		auto const input = make_operation(op, builder, this->key_base());
+		if (!dynamic_cast<input_operation const*>(&builder.graph.node(input))) {
 			throw py::value_error{"Invalid input operation in SFG."};
 		}
+		m_input_operations.push_back(input);
 	}
 }
 
-std::vector<std::shared_ptr<input_operation>> const& signal_flow_graph_operation::inputs() noexcept {
+std::vector<node_index> const& signal_flow_graph_operation::inputs() const noexcept {
 	return m_input_operations;
 }
 
@@ -31,16 +69,26 @@ std::size_t signal_flow_graph_operation::output_count() const noexcept {
 	return m_output_operations.size();
 }
 
-number signal_flow_graph_operation::evaluate_output(std::size_t index, evaluation_context const& context) const {
-	ASIC_DEBUG_MSG("Evaluating SFG.");
-	return m_output_operations.at(index).evaluate_output(0, context);
+slot_index signal_flow_graph_operation::compile_output(std::size_t index, compilation_context const& context) const {
+	ASIC_DEBUG_MSG("Compiling SFG.");
+	return m_output_operations.at(index).compile_output(0, context);
 }
 
-number signal_flow_graph_operation::evaluate_output_impl(std::size_t, evaluation_context const&) const {
-	return number{};
+std::optional<forwarded_signal> signal_flow_graph_operation::forwarded_output(std::size_t index) const {
+	return m_output_operations.at(index).forwarded_output(0);
+}
+
+void signal_flow_graph_operation::bypass_inputs(operation_graph& graph) {
+	for (auto& output : m_output_operations) {
+		output.bypass_inputs(graph);
+	}
 }
 
-signal_source signal_flow_graph_operation::make_source(pybind11::handle op, std::size_t input_index, added_operation_cache& added,
+slot_index signal_flow_graph_operation::compile_output_impl(std::size_t, compilation_context const&) const {
+	return no_slot;
+}
+
+signal_source signal_flow_graph_operation::make_source(pybind11::handle op, std::size_t input_index, graph_builder& builder,
 													   std::string_view prefix) {
 	auto const signal = py::object{op.attr("inputs")[py::int_{input_index}].attr("signals")[py::int_{0}]};
 	auto const src = py::handle{signal.attr("source")};
@@ -50,38 +98,28 @@ signal_source signal_flow_graph_operation::make_source(pybind11::handle op, std:
 	if (!signal.attr("bits").is_none()) {
 		bits = signal.attr("bits").cast<std::size_t>();
 	}
-	return signal_source{make_operation(operation, added, prefix), index, bits};
+	return signal_source{make_operation(operation, builder, prefix), index, bits, make_fixed_point_format(signal)};
 }
 
-std::shared_ptr<operation> signal_flow_graph_operation::add_signal_flow_graph_operation(pybind11::handle sfg, added_operation_cache& added,
-																						std::string_view prefix, result_key key) {
-	auto const new_op = add_operation<signal_flow_graph_operation>(sfg, added, std::move(key));
-	new_op->create(sfg, added);
+node_index signal_flow_graph_operation::add_signal_flow_graph_operation(pybind11::handle sfg, graph_builder& builder,
+																		std::string_view prefix, result_key key) {
+	auto const [index, new_op] = add_operation<signal_flow_graph_operation>(sfg, builder, std::move(key));
+	new_op->create(sfg, builder);
 	for (auto&& [i, input] : enumerate(new_op->inputs())) {
-		input->connect(make_source(sfg, i, added, prefix));
+		builder.graph.get<input_operation>(input).connect(make_source(sfg, i, builder, prefix));
 	}
-	return new_op;
+	return index;
 }
 
-std::shared_ptr<custom_operation> signal_flow_graph_operation::add_custom_operation(pybind11::handle op, added_operation_cache& added,
-																					std::string_view prefix, result_key key) {
-	auto const input_count = op.attr("input_count").cast<std::size_t>();
+node_index signal_flow_graph_operation::add_custom_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix,
+															 result_key key) {
 	auto const output_count = op.attr("output_count").cast<std::size_t>();
-	auto new_op = add_operation<custom_operation>(
-		op, added, std::move(key), op.attr("evaluate_output"), op.attr("quantize_input"), output_count);
-	auto inputs = std::vector<signal_source>{};
-	inputs.reserve(input_count);
-	for (auto const i : range(input_count)) {
-		inputs.push_back(make_source(op, i, added, prefix));
-	}
-	new_op->connect(std::move(inputs));
-	return new_op;
+	return add_nary_operation<custom_operation>(op, builder, prefix, std::move(key), op.attr("evaluate_output"),
+												py::getattr(op, "evaluate_output_block", py::none()), op.attr("quantize_input"), output_count);
 }
 
-std::shared_ptr<operation> signal_flow_graph_operation::make_operation(pybind11::handle op, added_operation_cache& added,
-																	   std::string_view prefix) {
-	if (auto const it = added.find(op.ptr()); it != added.end()) {
-		ASIC_ASSERT(it->second);
+node_index signal_flow_graph_operation::make_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix) {
+	if (auto const it = builder.added.find(op.ptr()); it != builder.added.end()) {
 		return it->second;
 	}
 	auto const graph_id = op.attr("graph_id").cast<std::string_view>();
@@ -89,56 +127,81 @@ std::shared_ptr<operation> signal_flow_graph_operation::make_operation(pybind11:
 	auto key = (prefix.empty()) ? result_key{graph_id} : fmt::format("{}.{}", prefix, graph_id);
 	if (type_name == "c") {
 		auto const value = op.attr("value").cast<number>();
-		return add_operation<constant_operation>(op, added, std::move(key), value);
+		return add_operation<constant_operation>(op, builder, std::move(key), value).first;
 	}
 	if (type_name == "add") {
-		return add_binary_operation<addition_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<addition_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "sub") {
-		return add_binary_operation<subtraction_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<subtraction_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "mul") {
-		return add_binary_operation<multiplication_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<multiplication_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "div") {
-		return add_binary_operation<division_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<division_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "min") {
-		return add_binary_operation<min_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<min_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "max") {
-		return add_binary_operation<max_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<max_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "sqrt") {
-		return add_unary_operation<square_root_operation>(op, added, prefix, std::move(key));
+		return add_unary_operation<square_root_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "conj") {
-		return add_unary_operation<complex_conjugate_operation>(op, added, prefix, std::move(key));
+		return add_unary_operation<complex_conjugate_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "abs") {
-		return add_unary_operation<absolute_operation>(op, added, prefix, std::move(key));
+		return add_unary_operation<absolute_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "cmul") {
 		auto const value = op.attr("value").cast<number>();
-		return add_unary_operation<constant_multiplication_operation>(op, added, prefix, std::move(key), value);
+		return add_unary_operation<constant_multiplication_operation>(op, builder, prefix, std::move(key), value);
 	}
 	if (type_name == "bfly") {
-		return add_binary_operation<butterfly_operation>(op, added, prefix, std::move(key));
+		return add_binary_operation<butterfly_operation>(op, builder, prefix, std::move(key));
+	}
+	if (type_name == "addsub") {
+		auto const is_add = op.attr("is_add").cast<bool>();
+		return add_binary_operation<addition_subtraction_operation>(op, builder, prefix, std::move(key), is_add);
+	}
+	if (type_name == "mad") {
+		return add_nary_operation<multiply_add_operation>(op, builder, prefix, std::move(key));
+	}
+	if (type_name == "sym2p") {
+		auto const value = op.attr("value").cast<number>();
+		return add_binary_operation<symmetric_twoport_adaptor_operation>(op, builder, prefix, std::move(key), value);
+	}
+	if (type_name == "rec") {
+		return add_unary_operation<reciprocal_operation>(op, builder, prefix, std::move(key));
+	}
+	if (type_name == "rshift") {
+		auto const value = op.attr("value").cast<int>();
+		return add_unary_operation<shift_operation>(op, builder, prefix, std::move(key), -value);
+	}
+	if (type_name == "lshift" || type_name == "shift") {
+		auto const value = op.attr("value").cast<int>();
+		return add_unary_operation<shift_operation>(op, builder, prefix, std::move(key), value);
+	}
+	if (type_name == "sink") {
+		return add_unary_operation<sink_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "in") {
-		return add_operation<input_operation>(op, added, std::move(key));
+		return add_operation<input_operation>(op, builder, std::move(key)).first;
 	}
 	if (type_name == "out") {
-		return add_unary_operation<output_operation>(op, added, prefix, std::move(key));
+		return add_unary_operation<output_operation>(op, builder, prefix, std::move(key));
 	}
 	if (type_name == "t") {
 		auto const initial_value = op.attr("initial_value").cast<number>();
-		return add_unary_operation<delay_operation>(op, added, prefix, std::move(key), initial_value);
+		return add_unary_operation<delay_operation>(op, builder, prefix, std::move(key), initial_value);
 	}
 	if (type_name == "sfg") {
-		return add_signal_flow_graph_operation(op, added, prefix, std::move(key));
+		return add_signal_flow_graph_operation(op, builder, prefix, std::move(key));
 	}
-	return add_custom_operation(op, added, prefix, std::move(key));
+	return add_custom_operation(op, builder, prefix, std::move(key));
 }
 
 } // namespace asic
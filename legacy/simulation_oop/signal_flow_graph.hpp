@@ -7,6 +7,7 @@
 #include "core_operations.hpp"
 #include "custom_operation.hpp"
 #include "operation.hpp"
+#include "operation_graph.hpp"
 #include "special_operations.hpp"
 
 #define NOMINMAX
@@ -14,7 +15,6 @@
 #include <cstddef>
 #include <fmt/format.h>
 #include <functional>
-#include <memory>
 #include <pybind11/pybind11.h>
 #include <stdexcept>
 #include <string_view>
@@ -26,56 +26,77 @@ namespace asic {
 
 class signal_flow_graph_operation final : public abstract_operation {
 public:
-	using added_operation_cache = std::unordered_map<PyObject const*, std::shared_ptr<operation>>;
+	// Operations are added to the graph once, even if they are reachable through several signals.
+	struct graph_builder final {
+		operation_graph& graph;
+		std::unordered_map<PyObject const*, node_index> added{};
+	};
 
 	signal_flow_graph_operation(result_key key);
 
-	void create(pybind11::handle sfg, added_operation_cache& added);
+	void create(pybind11::handle sfg, graph_builder& builder);
 
-	[[nodiscard]] std::vector<std::shared_ptr<input_operation>> const& inputs() noexcept;
+	[[nodiscard]] std::vector<node_index> const& inputs() const noexcept;
 	[[nodiscard]] std::size_t output_count() const noexcept final;
 
-	[[nodiscard]] number evaluate_output(std::size_t index, evaluation_context const& context) const final;
+	[[nodiscard]] slot_index compile_output(std::size_t index, compilation_context const& context) const final;
+	[[nodiscard]] std::optional<forwarded_signal> forwarded_output(std::size_t index) const final;
+	void bypass_inputs(operation_graph& graph) final;
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final;
 
-	[[nodiscard]] static signal_source make_source(pybind11::handle op, std::size_t input_index, added_operation_cache& added,
+	[[nodiscard]] static signal_source make_source(pybind11::handle op, std::size_t input_index, graph_builder& builder,
 												   std::string_view prefix);
 
+	// The operation is added before its inputs are created, so that feedback loops through delays refer back to it.
 	template <typename Operation, typename... Args>
-	[[nodiscard]] static std::shared_ptr<Operation> add_operation(pybind11::handle op, added_operation_cache& added, Args&&... args) {
-		return std::static_pointer_cast<Operation>(
-			added.try_emplace(op.ptr(), std::make_shared<Operation>(std::forward<Args>(args)...)).first->second);
+	[[nodiscard]] static std::pair<node_index, Operation*> add_operation(pybind11::handle op, graph_builder& builder, Args&&... args) {
+		auto const node = builder.graph.emplace<Operation>(std::forward<Args>(args)...);
+		builder.added.try_emplace(op.ptr(), node.first);
+		return node;
 	}
 
 	template <typename Operation, typename... Args>
-	[[nodiscard]] static std::shared_ptr<Operation> add_unary_operation(pybind11::handle op, added_operation_cache& added,
-																		std::string_view prefix, Args&&... args) {
-		auto new_op = add_operation<Operation>(op, added, std::forward<Args>(args)...);
-		new_op->connect(make_source(op, 0, added, prefix));
-		return new_op;
+	[[nodiscard]] static node_index add_unary_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix,
+														Args&&... args) {
+		auto const [index, new_op] = add_operation<Operation>(op, builder, std::forward<Args>(args)...);
+		new_op->connect(make_source(op, 0, builder, prefix));
+		return index;
 	}
 
 	template <typename Operation, typename... Args>
-	[[nodiscard]] static std::shared_ptr<Operation> add_binary_operation(pybind11::handle op, added_operation_cache& added,
-																		 std::string_view prefix, Args&&... args) {
-		auto new_op = add_operation<Operation>(op, added, std::forward<Args>(args)...);
-		new_op->connect(make_source(op, 0, added, prefix), make_source(op, 1, added, prefix));
-		return new_op;
+	[[nodiscard]] static node_index add_binary_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix,
+														 Args&&... args) {
+		auto const [index, new_op] = add_operation<Operation>(op, builder, std::forward<Args>(args)...);
+		new_op->connect(make_source(op, 0, builder, prefix), make_source(op, 1, builder, prefix));
+		return index;
 	}
 
-	[[nodiscard]] static std::shared_ptr<operation> add_signal_flow_graph_operation(pybind11::handle sfg, added_operation_cache& added,
-																					std::string_view prefix, result_key key);
+	template <typename Operation, typename... Args>
+	[[nodiscard]] static node_index add_nary_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix,
+													   Args&&... args) {
+		auto const input_count = op.attr("input_count").cast<std::size_t>();
+		auto const [index, new_op] = add_operation<Operation>(op, builder, std::forward<Args>(args)...);
+		auto inputs = std::vector<signal_source>{};
+		inputs.reserve(input_count);
+		for (auto const i : range(input_count)) {
+			inputs.push_back(make_source(op, i, builder, prefix));
+		}
+		new_op->connect(std::move(inputs));
+		return index;
+	}
+
+	[[nodiscard]] static node_index add_signal_flow_graph_operation(pybind11::handle sfg, graph_builder& builder, std::string_view prefix,
+																	result_key key);
 
-	[[nodiscard]] static std::shared_ptr<custom_operation> add_custom_operation(pybind11::handle op, added_operation_cache& added,
-																				std::string_view prefix, result_key key);
+	[[nodiscard]] static node_index add_custom_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix,
+														 result_key key);
 
-	[[nodiscard]] static std::shared_ptr<operation> make_operation(pybind11::handle op, added_operation_cache& added,
-																   std::string_view prefix);
+	[[nodiscard]] static node_index make_operation(pybind11::handle op, graph_builder& builder, std::string_view prefix);
 
 	std::vector<output_operation> m_output_operations{};
-	std::vector<std::shared_ptr<input_operation>> m_input_operations{};
+	std::vector<node_index> m_input_operations{};
 };
 
 } // namespace asic
@@ -0,0 +1,601 @@
+#include "signal_generator.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+#include "philox.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fmt/format.h>
+#include <pybind11/numpy.h>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace py = pybind11;
+
+namespace asic {
+
+namespace {
+
+using real_number = number::value_type;
+using generator_pointer = std::unique_ptr<signal_generator>;
+
+constexpr auto pi = 3.141592653589793; // math.pi
+
+// Products and quotients follow CPython, so that the values are the same as when the generators are called from Python.
+[[nodiscard]] number multiply(number lhs, number rhs) noexcept {
+	if (lhs.imag() == 0 && rhs.imag() == 0) {
+		return number{lhs.real() * rhs.real()};
+	}
+	return number{lhs.real() * rhs.real() - lhs.imag() * rhs.imag(), lhs.real() * rhs.imag() + lhs.imag() * rhs.real()};
+}
+
+[[nodiscard]] number divide(number lhs, number rhs) {
+	if (rhs == number{}) {
+		throw std::domain_error{"Division by zero in signal generator."};
+	}
+	if (lhs.imag() == 0 && rhs.imag() == 0) {
+		return number{lhs.real() / rhs.real()};
+	}
+	if (std::abs(rhs.real()) >= std::abs(rhs.imag())) {
+		auto const ratio = rhs.imag() / rhs.real();
+		auto const denominator = rhs.real() + rhs.imag() * ratio;
+		return number{(lhs.real() + lhs.imag() * ratio) / denominator, (lhs.imag() - lhs.real() * ratio) / denominator};
+	}
+	auto const ratio = rhs.real() / rhs.imag();
+	auto const denominator = rhs.real() * ratio + rhs.imag();
+	return number{(lhs.real() * ratio + lhs.imag()) / denominator, (lhs.imag() * ratio - lhs.real()) / denominator};
+}
+
+// Byte strings and dictionaries in saved states are preceded by their size.
+void append_size(std::string& state, std::size_t size) {
+	auto const value = static_cast<std::uint64_t>(size);
+	state.append(reinterpret_cast<char const*>(&value), sizeof(value)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+[[nodiscard]] std::uint64_t take_size(std::string_view& state) {
+	auto size = std::uint64_t{};
+	if (state.size() < sizeof(size)) {
+		throw py::value_error{"Signal generator state is truncated"};
+	}
+	std::memcpy(&size, state.data(), sizeof(size));
+	state.remove_prefix(sizeof(size));
+	return size;
+}
+
+void append_bytes(std::string& state, std::string_view bytes) {
+	append_size(state, bytes.size());
+	state.append(bytes);
+}
+
+[[nodiscard]] std::string_view take_bytes(std::string_view& state) {
+	auto const size = take_size(state);
+	if (state.size() < size) {
+		throw py::value_error{"Signal generator state is truncated"};
+	}
+	auto const bytes = state.substr(0, static_cast<std::size_t>(size));
+	state.remove_prefix(bytes.size());
+	return bytes;
+}
+
+// The state of a NumPy bit generator is a dictionary of strings, integers and integer arrays. It is written as tagged values
+// rather than pickled, so that loading a snapshot cannot run arbitrary code.
+constexpr auto max_state_depth = 4;
+
+[[nodiscard]] bool is_integer_dtype(std::string_view dtype) noexcept {
+	return dtype.size() == 3 && std::string_view{"<>|="}.find(dtype[0]) != std::string_view::npos &&
+		   (dtype[1] == 'i' || dtype[1] == 'u') && std::string_view{"1248"}.find(dtype[2]) != std::string_view::npos;
+}
+
+void write_state_value(std::string& state, py::handle value, int depth) {
+	if (depth > max_state_depth) {
+		throw py::value_error{"Random number generator state is nested too deeply"};
+	}
+	if (py::isinstance<py::dict>(value)) {
+		auto const dict = py::reinterpret_borrow<py::dict>(value);
+		state += 'd';
+		append_size(state, dict.size());
+		for (auto const& [key, item] : dict) {
+			if (!py::isinstance<py::str>(key)) {
+				throw py::value_error{"Random number generator state has a key that is not a string"};
+			}
+			append_bytes(state, key.cast<std::string>());
+			write_state_value(state, item, depth + 1);
+		}
+	} else if (py::isinstance<py::str>(value)) {
+		state += 's';
+		append_bytes(state, value.cast<std::string>());
+	} else if (py::isinstance<py::int_>(value)) {
+		state += 'i';
+		append_bytes(state, py::str{py::int_{py::reinterpret_borrow<py::object>(value)}}.cast<std::string>());
+	} else if (py::isinstance<py::array>(value)) {
+		auto const array = py::reinterpret_borrow<py::array>(value);
+		auto const dtype = array.dtype().attr("str").cast<std::string>();
+		if (array.ndim() != 1 || !is_integer_dtype(dtype)) {
+			throw py::value_error{fmt::format("Random number generator state has an unsupported array (dtype {})", dtype)};
+		}
+		state += 'a';
+		append_bytes(state, dtype);
+		append_bytes(state, array.attr("tobytes")().cast<std::string>());
+	} else {
+		throw py::value_error{fmt::format("Random number generator state has an unsupported value of type {}",
+										  py::str{value.get_type().attr("__name__")}.cast<std::string>())};
+	}
+}
+
+[[nodiscard]] py::object read_state_value(std::string_view& state, int depth) {
+	if (depth > max_state_depth) {
+		throw py::value_error{"Random number generator state is nested too deeply"};
+	}
+	if (state.empty()) {
+		throw py::value_error{"Signal generator state is truncated"};
+	}
+	auto const tag = state.front();
+	state.remove_prefix(1);
+	if (tag == 'd') {
+		auto dict = py::dict{};
+		for (auto const count = take_size(state); dict.size() < count;) {
+			auto const key = take_bytes(state);
+			auto const key_string = py::str{key.data(), key.size()};
+			if (dict.contains(key_string)) {
+				throw py::value_error{"Random number generator state has a repeated key"};
+			}
+			dict[key_string] = read_state_value(state, depth + 1);
+		}
+		return std::move(dict);
+	}
+	if (tag == 's') {
+		auto const text = take_bytes(state);
+		return py::str{text.data(), text.size()};
+	}
+	if (tag == 'i') {
+		auto const digits = take_bytes(state);
+		auto const first = digits.substr(0, 1) == "-" ? std::size_t{1} : std::size_t{0};
+		if (digits.size() == first || digits.find_first_not_of("0123456789", first) != std::string_view::npos) {
+			throw py::value_error{"Random number generator state has an invalid integer"};
+		}
+		return py::int_{py::str{digits.data(), digits.size()}};
+	}
+	if (tag == 'a') {
+		auto const dtype = take_bytes(state);
+		auto const bytes = take_bytes(state);
+		if (!is_integer_dtype(dtype)) {
+			throw py::value_error{"Random number generator state has an unsupported array"};
+		}
+		auto const item_size = static_cast<std::size_t>(dtype[2] - '0');
+		if (bytes.size() % item_size != 0) {
+			throw py::value_error{"Random number generator state has an array of the wrong size"};
+		}
+		auto const numpy = py::module_::import("numpy");
+		auto const type = numpy.attr("dtype")(py::str{dtype.data(), dtype.size()});
+		return numpy.attr("frombuffer")(py::bytes{bytes.data(), bytes.size()}, type).attr("copy")();
+	}
+	throw py::value_error{"Random number generator state has a value of an unknown type"};
+}
+
+// Generators without random number generators or inner generators, which are cloned by copying.
+template <typename Generator>
+class copyable_generator : public signal_generator {
+public:
+	[[nodiscard]] std::unique_ptr<signal_generator> clone(py::dict&) const final {
+		return std::make_unique<Generator>(static_cast<Generator const&>(*this));
+	}
+};
+
+class impulse_generator final : public copyable_generator<impulse_generator> {
+public:
+	explicit impulse_generator(time_index delay) noexcept
+		: m_delay(delay) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		std::transform(times.begin(), times.end(), values.begin(), [&](time_index time) { return number{(time == m_delay) ? 1.0 : 0.0}; });
+	}
+
+private:
+	time_index m_delay;
+};
+
+class step_generator final : public copyable_generator<step_generator> {
+public:
+	explicit step_generator(time_index delay) noexcept
+		: m_delay(delay) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		std::transform(times.begin(), times.end(), values.begin(), [&](time_index time) { return number{(time >= m_delay) ? 1.0 : 0.0}; });
+	}
+
+private:
+	time_index m_delay;
+};
+
+class constant_generator final : public copyable_generator<constant_generator> {
+public:
+	explicit constant_generator(number value) noexcept
+		: m_value(value) {}
+
+	void generate(span<time_index const>, span<number> values) final {
+		std::fill(values.begin(), values.end(), m_value);
+	}
+
+private:
+	number m_value;
+};
+
+// ZeroPad and FromFile.
+class sequence_generator final : public copyable_generator<sequence_generator> {
+public:
+	explicit sequence_generator(std::vector<number> data) noexcept
+		: m_data(std::move(data)) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		std::transform(times.begin(), times.end(), values.begin(), [&](time_index time) {
+			return (time >= 0 && static_cast<std::size_t>(time) < m_data.size()) ? m_data[static_cast<std::size_t>(time)] : number{};
+		});
+	}
+
+private:
+	std::vector<number> m_data;
+};
+
+class sinusoid_generator final : public copyable_generator<sinusoid_generator> {
+public:
+	sinusoid_generator(real_number frequency, real_number phase) noexcept
+		: m_frequency(frequency)
+		, m_phase(phase) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		std::transform(times.begin(), times.end(), values.begin(), [&](time_index time) {
+			return number{std::sin(pi * (m_frequency * static_cast<real_number>(time) + m_phase))};
+		});
+	}
+
+private:
+	real_number m_frequency;
+	real_number m_phase;
+};
+
+// Gaussian and Uniform, which draw one value per call from their NumPy generator. Drawing a whole block at once gives the same
+// sequence of values.
+class noise_generator final : public signal_generator {
+public:
+	noise_generator(py::object rng, char const* distribution, py::object first, py::object second)
+		: m_rng(std::move(rng))
+		, m_distribution(distribution)
+		, m_draw(m_rng.attr(distribution))
+		, m_first(std::move(first))
+		, m_second(std::move(second)) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		if (times.size() == 0) {
+			return;
+		}
+		using sample_array = py::array_t<real_number, py::array::c_style | py::array::forcecast>;
+		auto const samples = sample_array::ensure(m_draw(m_first, m_second, times.size()));
+		ASIC_ASSERT(samples && samples.size() == static_cast<py::ssize_t>(times.size()));
+		std::copy(samples.data(), samples.data() + times.size(), values.begin());
+	}
+
+	[[nodiscard]] bool requires_python() const noexcept final {
+		return true;
+	}
+
+	[[nodiscard]] std::unique_ptr<signal_generator> clone(py::dict& memo) const final {
+		return std::make_unique<noise_generator>(py::module_::import("copy").attr("deepcopy")(m_rng, memo), m_distribution, m_first,
+												 m_second);
+	}
+
+	void save_state(std::string& state) const final {
+		write_state_value(state, m_rng.attr("bit_generator").attr("state"), 0);
+	}
+
+	void read_state(std::string_view& state, std::vector<generator_state>& states) const final {
+		auto bit_generator = py::object{m_rng.attr("bit_generator")};
+		auto value = read_state_value(state, 0);
+		auto const type = py::object{bit_generator.attr("__class__")};
+		if (!py::isinstance<py::dict>(value) || !value.attr("get")("bit_generator").equal(type.attr("__name__"))) {
+			throw py::value_error{"Random number generator state is for another kind of bit generator"};
+		}
+		// Give the state to a new bit generator of the same kind first, so that it is known to fit before anything is restored.
+		try {
+			type().attr("state") = value;
+		} catch (py::error_already_set const&) {
+			throw py::value_error{"Random number generator state does not fit its bit generator"};
+		}
+		states.push_back(generator_state{std::move(bit_generator), std::move(value)});
+	}
+
+private:
+	py::object m_rng;
+	char const* m_distribution;
+	py::object m_draw;
+	py::object m_first;
+	py::object m_second;
+};
+
+// Gaussian and Uniform with counter_based set, where each value only depends on the seed, the stream and the time.
+class counter_noise_generator final : public copyable_generator<counter_noise_generator> {
+public:
+	counter_noise_generator(bool gaussian, std::uint64_t seed, std::uint64_t stream, real_number first, real_number second) noexcept
+		: m_gaussian(gaussian)
+		, m_seed(seed)
+		, m_stream(stream)
+		, m_first(first)
+		, m_second(second) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		std::transform(times.begin(), times.end(), values.begin(), [&](time_index time) {
+			auto const [u1, u2] = counter_uniforms(m_seed, m_stream, static_cast<std::uint64_t>(time));
+			if (m_gaussian) {
+				// Box-Muller, with the radius taken from (0, 1] to avoid the logarithm of zero.
+				return number{m_first + m_second * (std::sqrt(-2.0 * std::log(1.0 - u1)) * std::cos(2.0 * pi * u2))};
+			}
+			return number{m_first + (m_second - m_first) * u1};
+		});
+	}
+
+private:
+	bool m_gaussian;
+	std::uint64_t m_seed;
+	std::uint64_t m_stream;
+	real_number m_first;
+	real_number m_second;
+};
+
+// Delay and Downsample, which evaluate another generator at time * factor + offset.
+class time_scale_generator final : public signal_generator {
+public:
+	time_scale_generator(generator_pointer generator, time_index factor, time_index offset) noexcept
+		: m_generator(std::move(generator))
+		, m_factor(factor)
+		, m_offset(offset) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		m_times.resize(times.size());
+		std::transform(times.begin(), times.end(), m_times.begin(), [&](time_index time) { return time * m_factor + m_offset; });
+		m_generator->generate(m_times, values);
+	}
+
+	[[nodiscard]] bool requires_python() const noexcept final {
+		return m_generator->requires_python();
+	}
+
+	[[nodiscard]] std::unique_ptr<signal_generator> clone(py::dict& memo) const final {
+		return std::make_unique<time_scale_generator>(m_generator->clone(memo), m_factor, m_offset);
+	}
+
+	void save_state(std::string& state) const final {
+		m_generator->save_state(state);
+	}
+
+	void read_state(std::string_view& state, std::vector<generator_state>& states) const final {
+		m_generator->read_state(state, states);
+	}
+
+private:
+	generator_pointer m_generator;
+	time_index m_factor;
+	time_index m_offset;
+	std::vector<time_index> m_times{};
+};
+
+class upsample_generator final : public signal_generator {
+public:
+	upsample_generator(generator_pointer generator, time_index factor, time_index phase) noexcept
+		: m_generator(std::move(generator))
+		, m_factor(factor)
+		, m_phase(phase) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		m_times.clear();
+		m_positions.clear();
+		for (auto const& [i, time] : enumerate(times)) {
+			if ((time - m_phase) % m_factor == 0) {
+				m_times.push_back((time - m_phase) / m_factor);
+				m_positions.push_back(i);
+			}
+		}
+		m_values.resize(m_times.size());
+		m_generator->generate(m_times, m_values);
+		std::fill(values.begin(), values.end(), number{});
+		for (auto const& [position, value] : zip(m_positions, m_values)) {
+			values[position] = value;
+		}
+	}
+
+	[[nodiscard]] bool requires_python() const noexcept final {
+		return m_generator->requires_python();
+	}
+
+	[[nodiscard]] std::unique_ptr<signal_generator> clone(py::dict& memo) const final {
+		return std::make_unique<upsample_generator>(m_generator->clone(memo), m_factor, m_phase);
+	}
+
+	void save_state(std::string& state) const final {
+		m_generator->save_state(state);
+	}
+
+	void read_state(std::string_view& state, std::vector<generator_state>& states) const final {
+		m_generator->read_state(state, states);
+	}
+
+private:
+	generator_pointer m_generator;
+	time_index m_factor;
+	time_index m_phase;
+	std::vector<time_index> m_times{};
+	std::vector<std::size_t> m_positions{};
+	std::vector<number> m_values{};
+};
+
+enum class generator_operator { addition, subtraction, multiplication, division };
+
+class arithmetic_generator final : public signal_generator {
+public:
+	arithmetic_generator(generator_operator op, generator_pointer lhs, generator_pointer rhs) noexcept
+		: m_operator(op)
+		, m_lhs(std::move(lhs))
+		, m_rhs(std::move(rhs)) {}
+
+	void generate(span<time_index const> times, span<number> values) final {
+		m_values.resize(times.size());
+		m_lhs->generate(times, values);
+		m_rhs->generate(times, m_values);
+		switch (m_operator) {
+			case generator_operator::addition:
+				std::transform(values.begin(), values.end(), m_values.begin(), values.begin(), [](number a, number b) { return a + b; });
+				break;
+			case generator_operator::subtraction:
+				std::transform(values.begin(), values.end(), m_values.begin(), values.begin(), [](number a, number b) { return a - b; });
+				break;
+			case generator_operator::multiplication:
+				std::transform(values.begin(), values.end(), m_values.begin(), values.begin(), multiply);
+				break;
+			case generator_operator::division:
+				std::transform(values.begin(), values.end(), m_values.begin(), values.begin(), divide);
+				break;
+		}
+	}
+
+	[[nodiscard]] bool requires_python() const noexcept final {
+		return m_lhs->requires_python() || m_rhs->requires_python();
+	}
+
+	[[nodiscard]] std::unique_ptr<signal_generator> clone(py::dict& memo) const final {
+		return std::make_unique<arithmetic_generator>(m_operator, m_lhs->clone(memo), m_rhs->clone(memo));
+	}
+
+	void save_state(std::string& state) const final {
+		m_lhs->save_state(state);
+		m_rhs->save_state(state);
+	}
+
+	void read_state(std::string_view& state, std::vector<generator_state>& states) const final {
+		m_lhs->read_state(state, states);
+		m_rhs->read_state(state, states);
+	}
+
+private:
+	generator_operator m_operator;
+	generator_pointer m_lhs;
+	generator_pointer m_rhs;
+	std::vector<number> m_values{};
+};
+
+[[nodiscard]] time_index integer_attribute(py::handle generator, char const* name) {
+	auto const value = py::object{generator.attr(name)};
+	if (!py::isinstance<py::int_>(value)) {
+		throw py::cast_error{fmt::format("Signal generator attribute {} is not an integer", name)};
+	}
+	return value.cast<time_index>();
+}
+
+[[nodiscard]] generator_pointer make_generator(py::handle generator) {
+	auto const type = py::object{generator.attr("__class__")};
+	if (type.attr("__module__").cast<std::string_view>() != "b_asic.signal_generator") {
+		return nullptr;
+	}
+	auto const name = type.attr("__name__").cast<std::string_view>();
+	if (name == "Impulse") {
+		return std::make_unique<impulse_generator>(integer_attribute(generator, "_delay"));
+	}
+	if (name == "Step") {
+		return std::make_unique<step_generator>(integer_attribute(generator, "_delay"));
+	}
+	if (name == "Constant") {
+		return std::make_unique<constant_generator>(generator.attr("_constant").cast<number>());
+	}
+	if (name == "ZeroPad" || name == "FromFile") {
+		return std::make_unique<sequence_generator>(generator.attr("_data").cast<std::vector<number>>());
+	}
+	if (name == "Sinusoid") {
+		return std::make_unique<sinusoid_generator>(generator.attr("_frequency").cast<real_number>(),
+													generator.attr("_phase").cast<real_number>());
+	}
+	if (name == "Gaussian" || name == "Uniform") {
+		auto const gaussian = name == "Gaussian";
+		if (py::getattr(generator, "_counter_based", py::bool_{false}).cast<bool>()) {
+			return std::make_unique<counter_noise_generator>(
+				gaussian, generator.attr("_key").cast<std::uint64_t>(), static_cast<std::uint64_t>(integer_attribute(generator, "_stream")),
+				generator.attr(gaussian ? "_loc" : "_low").cast<real_number>(), generator.attr(gaussian ? "_scale" : "_high").cast<real_number>());
+		}
+		return std::make_unique<noise_generator>(generator.attr("_rng"), gaussian ? "normal" : "uniform",
+												 generator.attr(gaussian ? "_loc" : "_low"), generator.attr(gaussian ? "_scale" : "_high"));
+	}
+	if (name == "Delay" || name == "Downsample") {
+		auto inner = make_generator(generator.attr("_generator"));
+		if (!inner) {
+			return nullptr;
+		}
+		if (name == "Delay") {
+			return std::make_unique<time_scale_generator>(std::move(inner), 1, -integer_attribute(generator, "_delay"));
+		}
+		return std::make_unique<time_scale_generator>(std::move(inner), integer_attribute(generator, "_factor"),
+													  integer_attribute(generator, "_phase"));
+	}
+	if (name == "Upsample") {
+		auto const factor = integer_attribute(generator, "_factor");
+		auto inner = make_generator(generator.attr("_generator"));
+		if (!inner || factor <= 0) {
+			return nullptr;
+		}
+		return std::make_unique<upsample_generator>(std::move(inner), factor, integer_attribute(generator, "_phase"));
+	}
+	auto op = generator_operator::addition;
+	if (name == "_AddGenerator") {
+		op = generator_operator::addition;
+	} else if (name == "_SubGenerator") {
+		op = generator_operator::subtraction;
+	} else if (name == "_MulGenerator") {
+		op = generator_operator::multiplication;
+	} else if (name == "_DivGenerator") {
+		op = generator_operator::division;
+	} else {
+		return nullptr;
+	}
+	auto lhs = make_generator(generator.attr("_a"));
+	auto rhs = make_generator(generator.attr("_b"));
+	if (!lhs || !rhs) {
+		return nullptr;
+	}
+	return std::make_unique<arithmetic_generator>(op, std::move(lhs), std::move(rhs));
+}
+
+} // namespace
+
+bool signal_generator::requires_python() const noexcept {
+	return false;
+}
+
+void signal_generator::save_state(std::string&) const {}
+
+void signal_generator::read_state(std::string_view&, std::vector<generator_state>&) const {}
+
+std::unique_ptr<signal_generator> make_signal_generator(pybind11::handle generator) {
+	try {
+		return make_generator(generator);
+	} catch (py::cast_error const&) {
+		// Attributes of unexpected types are left to the Python implementation.
+		return nullptr;
+	}
+}
+
+void find_noise_sources(pybind11::handle generator, std::vector<PyObject const*>& sources) {
+	auto const type = py::object{generator.attr("__class__")};
+	auto const name = type.attr("__name__").cast<std::string_view>();
+	if (name == "Gaussian" || name == "Uniform") {
+		if (!py::getattr(generator, "_counter_based", py::bool_{false}).cast<bool>()) {
+			sources.push_back(py::object{generator.attr("_rng")}.ptr());
+		}
+	} else if (name == "Delay" || name == "Downsample" || name == "Upsample") {
+		find_noise_sources(generator.attr("_generator"), sources);
+	} else if (name == "_AddGenerator" || name == "_SubGenerator" || name == "_MulGenerator" || name == "_DivGenerator") {
+		find_noise_sources(generator.attr("_a"), sources);
+		find_noise_sources(generator.attr("_b"), sources);
+	}
+}
+
+} // namespace asic
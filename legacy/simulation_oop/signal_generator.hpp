@@ -0,0 +1,58 @@
+#ifndef ASIC_SIMULATION_SIGNAL_GENERATOR_HPP
+#define ASIC_SIMULATION_SIGNAL_GENERATOR_HPP
+
+#include "../number.hpp"
+#include "../span.hpp"
+
+#define NOMINMAX
+#include <cstdint>
+#include <memory>
+#include <pybind11/pybind11.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace asic {
+
+using time_index = std::int64_t;
+
+// A NumPy bit generator and a state to give it.
+struct generator_state {
+	pybind11::object bit_generator;
+	pybind11::object state;
+};
+
+// A native implementation of a generator from b_asic.signal_generator.
+class signal_generator { // NOLINT(cppcoreguidelines-special-member-functions)
+public:
+	signal_generator() noexcept = default;
+	virtual ~signal_generator() = default;
+
+	// Evaluate the generator at each of the given times. Noise generators draw their values in this order, like the Python
+	// generators do when called once per time.
+	virtual void generate(span<time_index const> times, span<number> values) = 0;
+
+	// Noise is drawn from the NumPy random number generator of the Python object.
+	[[nodiscard]] virtual bool requires_python() const noexcept;
+
+	// Copy the generator, giving it copies of the NumPy random number generators it draws from. Generators that are copied using the
+	// same memo share their copies, like with copy.deepcopy.
+	[[nodiscard]] virtual std::unique_ptr<signal_generator> clone(pybind11::dict& memo) const = 0;
+
+	// Append the state of the NumPy random number generators to the given bytes. read_state() takes a saved state from the front
+	// of the given bytes and checks that it fits, adding the states to give the bit generators once every generator has been read.
+	virtual void save_state(std::string& state) const;
+	virtual void read_state(std::string_view& state, std::vector<generator_state>& states) const;
+};
+
+// Build a native generator equivalent to the given Python one, or return null if it uses anything without a native
+// implementation, such as a user-defined generator.
+[[nodiscard]] std::unique_ptr<signal_generator> make_signal_generator(pybind11::handle generator);
+
+// Append the NumPy random number generators that a Python generator with a native implementation draws its noise from, once for
+// each place where it draws from them.
+void find_noise_sources(pybind11::handle generator, std::vector<PyObject const*>& sources);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_SIGNAL_GENERATOR_HPP
@@ -1,40 +1,361 @@
 #include "simulation.hpp"
 
 #include "../debug.hpp"
+#include "delay_lines.hpp"
+#include "optimize.hpp"
+#include "run.hpp"
+#include "schedule.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <numeric>
+#include <string_view>
+#include <type_traits>
 
 namespace py = pybind11;
 
 namespace asic {
 
-simulation::simulation(pybind11::handle sfg, std::optional<std::vector<std::optional<input_provider_type>>> input_providers)
-	: m_input_functions(sfg.attr("input_count").cast<std::size_t>(), [](iteration_type) -> number { return number{}; }) {
+namespace {
+
+[[nodiscard]] bool matches_pattern(std::string_view pattern, std::string_view key) noexcept {
+	auto p = std::size_t{0};
+	auto k = std::size_t{0};
+	auto star = std::string_view::npos;
+	auto star_key = std::size_t{0};
+	while (k < key.size()) {
+		if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == key[k])) {
+			++p;
+			++k;
+		} else if (p < pattern.size() && pattern[p] == '*') {
+			star = p++;
+			star_key = k;
+		} else if (star != std::string_view::npos) {
+			// Let the last star consume one more character and try again from there.
+			p = star + 1;
+			k = ++star_key;
+		} else {
+			return false;
+		}
+	}
+	while (p < pattern.size() && pattern[p] == '*') {
+		++p;
+	}
+	return p == pattern.size();
+}
+
+// A pattern also matches the results of every output of a multi-output operation, like a graph ID does.
+[[nodiscard]] bool matches_probe(std::string_view pattern, std::string_view key) noexcept {
+	if (matches_pattern(pattern, key)) {
+		return true;
+	}
+	auto const dot = key.rfind('.');
+	return dot != std::string_view::npos && dot + 1 < key.size() &&
+		std::all_of(key.begin() + static_cast<std::ptrdiff_t>(dot + 1), key.end(), [](char c) { return c >= '0' && c <= '9'; }) &&
+		matches_pattern(pattern, key.substr(0, dot));
+}
+
+template <typename T>
+[[nodiscard]] py::array make_result_array(recorded_values<T> values, std::size_t lanes) {
+	auto const* const data = values.buffer->data() + values.offset;
+	auto const size = static_cast<py::ssize_t>(values.size);
+	auto const owner =
+		py::capsule{new result_buffer<T>{std::move(values.buffer)}, [](void* p) { delete static_cast<result_buffer<T>*>(p); }};
+	if (lanes == 1) {
+		return py::array{size, data, owner};
+	}
+	// The values are interleaved by lane, so use strides that give one row per lane.
+	auto const lane_count = static_cast<py::ssize_t>(lanes);
+	auto const item_size = static_cast<py::ssize_t>(sizeof(T));
+	return py::array{std::vector<py::ssize_t>{lane_count, size / lane_count}, std::vector<py::ssize_t>{item_size, lane_count * item_size},
+					 data, owner};
+}
+
+template <typename Sample>
+[[nodiscard]] number read_sample(char const* data) noexcept {
+	// NumPy arrays are not always aligned.
+	auto sample = Sample{};
+	std::memcpy(&sample, data, sizeof(Sample));
+	return number{sample};
+}
+
+template <typename Sample>
+[[nodiscard]] input_block_function_type make_buffer_reader(std::shared_ptr<py::buffer_info> info, std::size_t lanes) {
+	auto const* const data = static_cast<char const*>(info->ptr);
+	auto const iteration_stride = static_cast<std::ptrdiff_t>(info->strides.back());
+	if (info->ndim == 1) {
+		return [info = std::move(info), data, iteration_stride, lanes](iteration_type start, std::size_t count, span<number> values) {
+			for (auto const n : range(count)) {
+				auto const value = read_sample<Sample>(data + static_cast<std::ptrdiff_t>(start + n) * iteration_stride);
+				std::fill_n(values.begin() + static_cast<std::ptrdiff_t>(n * lanes), lanes, value);
+			}
+		};
+	}
+	auto const lane_stride = static_cast<std::ptrdiff_t>(info->strides.front());
+	return [info = std::move(info), data, iteration_stride, lane_stride, lanes](iteration_type start, std::size_t count,
+																				span<number> values) {
+		for (auto const n : range(count)) {
+			auto const* const iteration_data = data + static_cast<std::ptrdiff_t>(start + n) * iteration_stride;
+			for (auto const l : range(lanes)) {
+				values[n * lanes + l] = read_sample<Sample>(iteration_data + static_cast<std::ptrdiff_t>(l) * lane_stride);
+			}
+		}
+	};
+}
+
+[[nodiscard]] input_block_function_type make_generator_input(std::shared_ptr<signal_generator> generator, std::size_t lanes) {
+	return [generator = std::move(generator), times = std::vector<time_index>{}, samples = std::vector<number>{},
+			lanes](iteration_type start, std::size_t count, span<number> values) mutable {
+		times.resize(count);
+		std::iota(times.begin(), times.end(), time_index{start});
+		samples.resize(count);
+		generator->generate(times, samples);
+		for (auto const n : range(count)) {
+			std::fill_n(values.begin() + static_cast<std::ptrdiff_t>(n * lanes), lanes, samples[n]);
+		}
+	};
+}
+
+// Snapshots hold plain values in the byte order of the machine, like the streamed result files.
+constexpr auto snapshot_magic = std::string_view{"BASICSS1"};
+
+template <typename T>
+void write_value(std::string& data, T value) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	data.append(reinterpret_cast<char const*>(&value), sizeof(T)); // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+}
+
+template <typename T>
+[[nodiscard]] T read_value(std::string_view& data) {
+	static_assert(std::is_trivially_copyable_v<T>);
+	if (data.size() < sizeof(T)) {
+		throw py::value_error{"Simulation snapshot is truncated"};
+	}
+	auto value = T{};
+	std::memcpy(&value, data.data(), sizeof(T));
+	data.remove_prefix(sizeof(T));
+	return value;
+}
+
+template <typename T>
+[[nodiscard]] std::vector<T> read_values(std::string_view& data, std::size_t count) {
+	if (data.size() / sizeof(T) < count) {
+		throw py::value_error{"Simulation snapshot is truncated"};
+	}
+	auto values = std::vector<T>(count);
+	std::memcpy(values.data(), data.data(), count * sizeof(T));
+	data.remove_prefix(count * sizeof(T));
+	return values;
+}
+
+} // namespace
+
+simulation::simulation(pybind11::handle sfg, std::optional<std::vector<std::optional<input_provider_type>>> input_providers,
+					   std::size_t block_size, std::size_t lanes, probe_set_type probes, recording_policy recording,
+					   kernel_options kernels, bool state_space)
+	: m_kernel_options(std::move(kernels))
+	, m_state_space_enabled(state_space)
+	, m_block_size(block_size)
+	, m_lanes(lanes)
+	, m_probes(std::move(probes))
+	, m_recording(std::move(recording))
+	, m_input_functions(sfg.attr("input_count").cast<std::size_t>(), [](iteration_type, std::size_t, span<number> values) {
+		std::fill(values.begin(), values.end(), number{});
+	})
+	, m_iteration_inputs(m_input_functions.size())
+	, m_input_generators(m_input_functions.size())
+	, m_generator_objects(m_input_functions.size())
+	, m_python_inputs(m_input_functions.size()) {
+	if (m_block_size == 0) {
+		throw py::value_error{"Simulation block size must be at least 1"};
+	}
+	if (m_lanes == 0) {
+		throw py::value_error{"Simulation lane count must be at least 1"};
+	}
+	if (auto const* const name = std::get_if<std::string>(&m_probes); name && *name != "all" && *name != "outputs") {
+		throw py::value_error{fmt::format("Unknown simulation probe set \"{}\" (expected \"all\", \"outputs\" or a list of patterns)", *name)};
+	}
+	if (m_recording.mode == recording_mode::ring && m_recording.length == 0) {
+		throw py::value_error{"Simulation ring buffer length must be at least 1"};
+	}
+	if (m_recording.mode == recording_mode::decimate && m_recording.factor == 0) {
+		throw py::value_error{"Simulation decimation factor must be at least 1"};
+	}
+	if (m_recording.mode == recording_mode::trigger && m_recording.after == 0) {
+		throw py::value_error{"Simulation trigger window must include at least 1 iteration after the trigger"};
+	}
 	if (input_providers) {
 		this->set_inputs(std::move(*input_providers));
 	}
-	auto added = signal_flow_graph_operation::added_operation_cache{};
-	m_sfg.create(sfg, added);
+	// The top-level graph is a node of the graph as well, so that forks only need to share the graph.
+	auto graph = std::make_shared<operation_graph>();
+	auto builder = signal_flow_graph_operation::graph_builder{*graph};
+	auto const [root, root_op] = graph->emplace<signal_flow_graph_operation>("");
+	root_op->create(sfg, builder);
+	graph->bypass_forwarded_signals();
+	m_graph = std::move(graph);
+	m_sfg = root;
+}
+
+simulation::simulation(simulation const& other)
+	: m_graph(other.m_graph)
+	, m_sfg(other.m_sfg)
+	, m_code(other.m_code)
+	, m_code_bits_override(other.m_code_bits_override)
+	, m_code_quantize(other.m_code_quantize)
+	, m_code_requires_python(other.m_code_requires_python)
+	, m_kernel(other.m_kernel)
+	, m_kernel_options(other.m_kernel_options)
+	, m_state_space(other.m_state_space)
+	, m_state_space_records(other.m_state_space_records)
+	, m_state_space_enabled(other.m_state_space_enabled)
+	, m_block_size(other.m_block_size)
+	, m_lanes(other.m_lanes)
+	, m_probes(other.m_probes)
+	, m_probed_results(other.m_probed_results)
+	, m_probed_offsets(other.m_probed_offsets)
+	, m_recording(other.m_recording)
+	, m_trigger_offset(other.m_trigger_offset)
+	, m_optimization(other.m_optimization)
+	, m_output_selections(other.m_output_selections)
+	, m_iteration(other.m_iteration)
+	, m_input_length(other.m_input_length)
+	, m_input_functions(other.m_input_functions)
+	, m_iteration_inputs(other.m_iteration_inputs)
+	, m_input_generators(other.m_input_generators)
+	, m_generator_objects(other.m_generator_objects)
+	, m_python_inputs(other.m_python_inputs) {
+	std::visit(
+		[&](auto const& state) {
+			using sample_type = typename std::decay_t<decltype(state.values)>::value_type;
+			auto copy = simulation_state<sample_type>{};
+			copy.values.assign(state.values.size(), sample_type{});
+			copy.delays = state.delays;
+			if (m_code) {
+				copy.results = recorder<sample_type>{m_recording, m_probed_results.size(), m_lanes};
+			}
+			m_state = std::move(copy);
+		},
+		other.m_state);
+	auto memo = py::dict{};
+	for (auto&& [i, generator] : enumerate(m_input_generators)) {
+		if (generator) {
+			generator = generator->clone(memo);
+			m_input_functions[i] = make_generator_input(generator, m_lanes);
+		}
+	}
+	// The Python generators of noise inputs are copied with the same memo, so that they draw from the same copies.
+	auto const deepcopy = py::module_::import("copy").attr("deepcopy");
+	for (auto&& [i, object] : enumerate(m_generator_objects)) {
+		auto const& generator = m_input_generators[i];
+		if (object && (!generator || generator->requires_python())) {
+			object = deepcopy(object, memo).cast<input_function_type>();
+			if (!generator) {
+				m_iteration_inputs[i] = object;
+			}
+		}
+	}
 }
 
 void simulation::set_input(std::size_t index, input_provider_type input_provider) {
+	this->assign_input(index, std::move(input_provider));
+	this->share_noise();
+}
+
+void simulation::assign_input(std::size_t index, input_provider_type input_provider) {
 	if (index >= m_input_functions.size()) {
 		throw py::index_error{fmt::format("Input index out of range (expected 0-{}, got {})", m_input_functions.size() - 1, index)};
 	}
+	m_python_inputs[index] = std::holds_alternative<input_function_type>(input_provider);
+	m_iteration_inputs[index] = input_function_type{};
+	m_input_generators[index].reset();
+	m_generator_objects[index] = input_function_type{};
+	auto const lanes = m_lanes;
 	if (auto* const callable = std::get_if<input_function_type>(&input_provider)) {
-		m_input_functions[index] = std::move(*callable);
+		if (auto generator = std::shared_ptr<signal_generator>{make_signal_generator(*callable)}) {
+			m_python_inputs[index] = generator->requires_python();
+			m_input_functions[index] = make_generator_input(generator, lanes);
+			m_input_generators[index] = std::move(generator);
+			m_generator_objects[index] = *callable;
+		} else if (auto block_function = py::getattr(*callable, "evaluate_block", py::none()); !block_function.is_none()) {
+			m_input_functions[index] = [function = std::move(block_function), lanes](iteration_type start, std::size_t count,
+																					  span<number> values) {
+				auto const block = number_array::ensure(function(start, count));
+				if (!block || block.ndim() != 1 || block.shape(0) != static_cast<py::ssize_t>(count)) {
+					throw py::value_error{fmt::format("Block input function must return one value per iteration (expected {})", count)};
+				}
+				for (auto const n : range(count)) {
+					std::fill_n(values.begin() + static_cast<std::ptrdiff_t>(n * lanes), lanes, block.data()[n]);
+				}
+			};
+		} else {
+			m_input_functions[index] = nullptr;
+			m_iteration_inputs[index] = std::move(*callable);
+		}
+	} else if (auto* const buffer = std::get_if<py::buffer>(&input_provider)) {
+		m_input_functions[index] = this->make_buffer_input(*buffer);
 	} else if (auto* const numeric = std::get_if<number>(&input_provider)) {
-		m_input_functions[index] = [value = *numeric](iteration_type) -> number {
-			return value;
+		m_input_functions[index] = [value = *numeric](iteration_type, std::size_t, span<number> values) {
+			std::fill(values.begin(), values.end(), value);
 		};
 	} else if (auto* const list = std::get_if<std::vector<number>>(&input_provider)) {
-		if (!m_input_length) {
-			m_input_length = static_cast<iteration_type>(list->size());
-		} else if (*m_input_length != static_cast<iteration_type>(list->size())) {
-			throw py::value_error{fmt::format("Inconsistent input length for simulation (was {}, got {})", *m_input_length, list->size())};
+		this->check_input_length(list->size());
+		m_input_functions[index] = [values = std::move(*list), lanes](iteration_type start, std::size_t count, span<number> lane_values) {
+			for (auto const n : range(count)) {
+				std::fill_n(lane_values.begin() + static_cast<std::ptrdiff_t>(n * lanes), lanes, values[start + n]);
+			}
+		};
+	} else if (auto* const lane_lists = std::get_if<std::vector<std::vector<number>>>(&input_provider)) {
+		if (lane_lists->size() != m_lanes) {
+			throw py::value_error{
+				fmt::format("Wrong number of input lanes supplied to simulation (expected {}, got {})", m_lanes, lane_lists->size())};
+		}
+		for (auto const& list : *lane_lists) {
+			this->check_input_length(list.size());
 		}
-		m_input_functions[index] = [values = std::move(*list)](iteration_type n) -> number {
-			return values.at(n);
+		m_input_functions[index] = [values = std::move(*lane_lists), lanes](iteration_type start, std::size_t count,
+																			span<number> lane_values) {
+			for (auto const n : range(count)) {
+				for (auto&& [l, list] : enumerate(values)) {
+					lane_values[n * lanes + l] = list[start + n];
+				}
+			}
+		};
+	}
+}
+
+input_block_function_type simulation::make_buffer_input(pybind11::buffer const& buffer) {
+	auto info = std::make_shared<py::buffer_info>(buffer.request());
+	auto const is_real = info->format == py::format_descriptor<real_number>::format();
+	if (!is_real && info->format != py::format_descriptor<number>::format()) {
+		throw py::type_error{fmt::format("Simulation input buffers must hold float64 or complex128 values (got format \"{}\")", info->format)};
+	}
+	if (info->ndim == 0) {
+		auto const value = is_real ? read_sample<real_number>(static_cast<char const*>(info->ptr))
+								   : read_sample<number>(static_cast<char const*>(info->ptr));
+		return [value](iteration_type, std::size_t, span<number> values) {
+			std::fill(values.begin(), values.end(), value);
 		};
 	}
+	if (info->ndim > 2) {
+		throw py::value_error{fmt::format("Simulation input buffers must have 1 or 2 dimensions (got {})", info->ndim)};
+	}
+	if (info->ndim == 2 && info->shape.front() != static_cast<py::ssize_t>(m_lanes)) {
+		throw py::value_error{
+			fmt::format("Wrong number of input lanes supplied to simulation (expected {}, got {})", m_lanes, info->shape.front())};
+	}
+	this->check_input_length(static_cast<std::size_t>(info->shape.back()));
+	return is_real ? make_buffer_reader<real_number>(std::move(info), m_lanes) : make_buffer_reader<number>(std::move(info), m_lanes);
+}
+
+void simulation::check_input_length(std::size_t length) {
+	if (!m_input_length) {
+		m_input_length = static_cast<iteration_type>(length);
+	} else if (*m_input_length != static_cast<iteration_type>(length)) {
+		throw py::value_error{fmt::format("Inconsistent input length for simulation (was {}, got {})", *m_input_length, length)};
+	}
 }
 
 void simulation::set_inputs(
@@ -45,71 +366,170 @@ void simulation::set_inputs(
 	}
 	for (auto&& [i, input_provider] : enumerate(input_providers)) {
 		if (input_provider) {
-			this->set_input(i, std::move(*input_provider));
+			this->assign_input(i, std::move(*input_provider));
 		}
 	}
+	this->share_noise();
 }
 
-std::vector<number> simulation::step(bool save_results, std::optional<std::size_t> bits_override, bool quantize) {
-	return this->run_for(1, save_results, bits_override, quantize);
+void simulation::share_noise() {
+	// Native noise generators draw a block at a time, so when several of them draw from the same NumPy generator, in one input or
+	// across inputs, they are called from Python once per iteration instead to keep the order of the values.
+	auto sources = std::vector<std::vector<PyObject const*>>(m_generator_objects.size());
+	auto uses = std::unordered_map<PyObject const*, std::size_t>{};
+	for (auto&& [i, object] : enumerate(m_generator_objects)) {
+		if (object) {
+			find_noise_sources(object, sources[i]);
+			for (auto const source : sources[i]) {
+				++uses[source];
+			}
+		}
+	}
+	for (auto&& [i, generator] : enumerate(m_input_generators)) {
+		if (generator && std::any_of(sources[i].begin(), sources[i].end(), [&](PyObject const* source) { return uses[source] > 1; })) {
+			generator.reset();
+			m_input_functions[i] = nullptr;
+			m_iteration_inputs[i] = m_generator_objects[i];
+			m_python_inputs[i] = true;
+		}
+	}
+}
+
+std::vector<number> simulation::step(bool save_results, std::optional<std::size_t> bits_override, bool quantize,
+									 std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays) {
+	return this->run_for(1, save_results, bits_override, quantize, outputs, advance_delays);
 }
 
 std::vector<number> simulation::run_until(iteration_type iteration, bool save_results, std::optional<std::size_t> bits_override,
-										  bool quantize) {
+										  bool quantize, std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays) {
+	this->compile(bits_override, quantize);
 	auto result = std::vector<number>{};
+	if (m_iteration >= iteration) {
+		return result;
+	}
+	auto const record = save_results || std::visit([](auto const& state) { return state.stream.has_value(); }, m_state);
+	auto block = block_program{};
+	auto code_requires_python = m_code_requires_python;
+	if (outputs) {
+		auto const& selection = this->select_outputs(*outputs, advance_delays, record);
+		block = block_program{selection.code.get(), selection.native_kernel.get(), selection.model.get(), selection.probed_offsets,
+							  selection.trigger_offset};
+		code_requires_python = selection.requires_python;
+	} else {
+		auto const* const model = (!record || m_state_space_records) ? m_state_space.get() : nullptr;
+		block = block_program{m_code.get(), m_kernel.get(), model, m_probed_offsets, m_trigger_offset};
+	}
+	auto const& code = *block.code;
+	// Input lists and buffers are indexed without further checks.
+	if (m_input_length && iteration > *m_input_length) {
+		throw py::index_error{fmt::format("Simulation inputs only hold {} iterations (requested {})", *m_input_length, iteration)};
+	}
+	// Other Python threads can run while simulating unless the graph or the inputs call back into Python.
+	auto gil = std::optional<py::gil_scoped_release>{};
+	if (!code_requires_python && std::none_of(m_python_inputs.begin(), m_python_inputs.end(), [](bool python) { return python; })) {
+		gil.emplace();
+	}
+	std::visit(
+		[&](auto& state) {
+			// Programs of different selections lay out their values differently, but none of them keeps values between blocks.
+			if (state.values.size() < code.value_count) {
+				state.values.resize(code.value_count);
+			}
+			if (save_results) {
+				state.results.reserve(static_cast<std::size_t>(iteration - m_iteration));
+			}
+		},
+		m_state);
+	auto const stride = m_block_size * m_lanes;
+	m_input_values.resize(m_input_functions.size() * stride);
+	auto const has_iteration_inputs = std::any_of(m_iteration_inputs.begin(), m_iteration_inputs.end(),
+												  [](input_function_type const& function) { return static_cast<bool>(function); });
+	// Python operations that are called once per iteration follow the Python input functions of the same iteration.
+	auto const block_size = (has_iteration_inputs && calls_python_per_iteration(code)) ? std::size_t{1} : m_block_size;
+	auto count = std::size_t{0};
 	while (m_iteration < iteration) {
-		ASIC_DEBUG_MSG("Running simulation iteration.");
-		for (auto&& [input, function] : zip(m_sfg.inputs(), m_input_functions)) {
-			input->value(function(m_iteration));
+		ASIC_DEBUG_MSG("Running simulation block.");
+		count = std::min(block_size, static_cast<std::size_t>(iteration - m_iteration));
+		for (auto&& [i, function] : enumerate(m_input_functions)) {
+			if (function) {
+				function(m_iteration, count, span<number>{m_input_values.data() + i * stride, count * m_lanes});
+			}
 		}
-
-		result.clear();
-		result.reserve(m_sfg.output_count());
-
-		auto results = result_map{};
-		auto deferred_delays = delay_queue{};
-		auto context = evaluation_context{};
-		context.results = &results;
-		context.delays = &m_delays;
-		context.deferred_delays = &deferred_delays;
-		context.bits_override = bits_override;
-		context.quantize = quantize;
-
-		for (auto const i : range(m_sfg.output_count())) {
-			result.push_back(m_sfg.evaluate_output(i, context));
+		// Like when evaluating one iteration at a time, so that Python functions sharing state are called in the same order.
+		if (has_iteration_inputs) {
+			for (auto const n : range(count)) {
+				for (auto&& [i, function] : enumerate(m_iteration_inputs)) {
+					if (function) {
+						auto const value = function(m_iteration + static_cast<iteration_type>(n)).cast<number>();
+						std::fill_n(m_input_values.begin() + static_cast<std::ptrdiff_t>(i * stride + n * m_lanes), m_lanes, value);
+					}
+				}
+			}
 		}
-
-		while (!deferred_delays.empty()) {
-			auto new_deferred_delays = delay_queue{};
-			context.deferred_delays = &new_deferred_delays;
-			for (auto const& [key, src] : deferred_delays) {
-				ASIC_ASSERT(src);
-				m_delays[key] = src->evaluate_output(context);
+		if (std::holds_alternative<simulation_state<real_number>>(m_state) &&
+			std::any_of(m_input_values.begin(), m_input_values.end(), [](number value) { return value.imag() != 0; })) {
+			this->promote_to_complex();
+		}
+		std::visit([&](auto& state) { this->run_block(state, block, count, save_results); }, m_state);
+		m_iteration += static_cast<iteration_type>(count);
+	}
+	// With multiple lanes, the values of all lanes are returned for each output in turn.
+	result.reserve(code.output_slots.size() * m_lanes);
+	std::visit(
+		[&](auto const& state) {
+			for (auto const slot : code.output_slots) {
+				auto const* const last = state.values.data() + code.slot_offsets[slot] + (count - 1) * m_lanes;
+				result.insert(result.end(), last, last + m_lanes);
 			}
-			deferred_delays = std::move(new_deferred_delays);
+		},
+		m_state);
+	return result;
+}
+
+template <typename T>
+void simulation::run_block(simulation_state<T>& state, block_program const& block, std::size_t count, bool save_results) {
+	auto const& code = *block.code;
+	auto const stride = m_block_size * m_lanes;
+	for (auto&& [i, slot] : enumerate(code.input_slots)) {
+		if (slot != no_slot) {
+			auto const* const inputs = m_input_values.data() + i * stride;
+			std::transform(inputs, inputs + count * m_lanes, state.values.data() + code.slot_offsets[slot], sample_cast<T>);
 		}
+	}
 
-		if (save_results) {
-			for (auto const& [key, value] : results) {
-				m_results[key].push_back(value.value());
-			}
+	auto const values = span<T>{state.values.data(), code.value_count};
+	if (block.model) {
+		run_state_space<T>(*block.model, values, state.delays, m_lanes, count);
+	} else if constexpr (std::is_same_v<T, real_number>) {
+		if (block.native_kernel) {
+			run_kernel(*block.native_kernel, values, state.delays, count);
+		} else {
+			run_program<T>(code, values, state.delays, m_block_size, m_lanes, count);
 		}
-		++m_iteration;
+	} else {
+		run_program<T>(code, values, state.delays, m_block_size, m_lanes, count);
+	}
+
+	if (save_results) {
+		state.results.record(m_iteration, count, state.values, block.probed_offsets, block.trigger_offset);
+	}
+	if (state.stream) {
+		state.stream->record(count, state.values, block.probed_offsets);
 	}
-	return result;
 }
 
 std::vector<number> simulation::run_for(iteration_type iterations, bool save_results, std::optional<std::size_t> bits_override,
-										bool quantize) {
+										bool quantize, std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays) {
 	if (iterations > std::numeric_limits<iteration_type>::max() - m_iteration) {
 		throw py::value_error("Simulation iteration type overflow!");
 	}
-	return this->run_until(m_iteration + iterations, save_results, bits_override, quantize);
+	return this->run_until(m_iteration + iterations, save_results, bits_override, quantize, outputs, advance_delays);
 }
 
-std::vector<number> simulation::run(bool save_results, std::optional<std::size_t> bits_override, bool quantize) {
+std::vector<number> simulation::run(bool save_results, std::optional<std::size_t> bits_override, bool quantize,
+									std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays) {
 	if (m_input_length) {
-		return this->run_until(*m_input_length, save_results, bits_override, quantize);
+		return this->run_until(*m_input_length, save_results, bits_override, quantize, outputs, advance_delays);
 	}
 	throw py::index_error{"Tried to run unlimited simulation"};
 }
@@ -118,20 +538,485 @@ iteration_type simulation::iteration() const noexcept {
 	return m_iteration;
 }
 
-pybind11::dict simulation::results() const noexcept {
+std::size_t simulation::lanes() const noexcept {
+	return m_lanes;
+}
+
+std::optional<iteration_type> simulation::trigger_iteration() const noexcept {
+	return std::visit([](auto const& state) { return state.results.trigger_iteration(); }, m_state);
+}
+
+pybind11::dict simulation::results() const {
+	using namespace pybind11::literals;
 	auto results = py::dict{};
-	for (auto const& [key, values] : m_results) {
-		results[py::str{key}] = py::array{static_cast<py::ssize_t>(values.size()), values.data()};
-	}
+	std::visit(
+		[&](auto const& state) {
+			if (state.results.empty()) {
+				return;
+			}
+			ASIC_ASSERT(m_code);
+			for (auto&& [i, result] : enumerate(m_probed_results)) {
+				auto const& key = m_code->result_keys[result];
+				auto array = make_result_array(state.results.values(i), m_lanes);
+				array.attr("setflags")("write"_a = false);
+				results[py::str{key}] = std::move(array);
+			}
+		},
+		m_state);
+	return results;
+}
+
+pybind11::dict simulation::take_results() {
+	auto results = py::dict{};
+	std::visit(
+		[&](auto& state) {
+			if (state.results.empty()) {
+				return;
+			}
+			ASIC_ASSERT(m_code);
+			for (auto&& [i, result] : enumerate(m_probed_results)) {
+				auto const& key = m_code->result_keys[result];
+				results[py::str{key}] = make_result_array(state.results.values(i), m_lanes);
+			}
+			state.results.clear();
+		},
+		m_state);
 	return results;
 }
 
+pybind11::dict simulation::optimization_statistics() {
+	if (!m_code) {
+		// The same instructions are removed for all settings, so use the ones of running without arguments.
+		this->compile(std::nullopt, true);
+	}
+	auto statistics = py::dict{};
+	statistics["folded"] = m_optimization.folded;
+	statistics["merged"] = m_optimization.merged;
+	statistics["pruned"] = m_optimization.pruned;
+	statistics["instructions"] = m_code->instructions.size();
+	statistics["removed_keys"] = m_optimization.removed_keys;
+	return statistics;
+}
+
+pybind11::dict simulation::graph_statistics() const {
+	auto const nodes = m_graph->node_count();
+	auto const bytes = m_graph->size_bytes();
+	auto statistics = py::dict{};
+	statistics["nodes"] = nodes;
+	statistics["bytes"] = bytes;
+	statistics["bytes_per_node"] = (nodes == 0) ? 0.0 : static_cast<double>(bytes) / static_cast<double>(nodes);
+	return statistics;
+}
+
+std::vector<result_key> simulation::stream_results(std::string const& path, std::size_t iterations, bool combined) {
+	if (!m_code) {
+		// Use the same settings as running without arguments, since the probed results do not depend on them.
+		this->compile(std::nullopt, true);
+	}
+	auto keys = std::vector<result_key>{};
+	keys.reserve(m_probed_results.size());
+	for (auto const result : m_probed_results) {
+		keys.push_back(m_code->result_keys[result]);
+	}
+	std::visit(
+		[&](auto& state) {
+			state.stream.reset(); // Close any previous files first, in case they are replaced.
+			state.stream.emplace(path, keys, iterations, m_lanes, combined);
+		},
+		m_state);
+	return keys;
+}
+
+void simulation::close_stream() noexcept {
+	std::visit([](auto& state) { state.stream.reset(); }, m_state);
+}
+
+void simulation::compile(std::optional<std::size_t> bits_override, bool quantize) {
+	if (m_code && m_code_bits_override == bits_override && m_code_quantize == quantize) {
+		return;
+	}
+	ASIC_DEBUG_MSG("Compiling simulation.");
+	auto code = program{};
+	auto slots = slot_map{};
+	auto deferred_delays = delay_queue{};
+	auto const& sfg = m_graph->get<signal_flow_graph_operation>(m_sfg);
+	auto context = compilation_context{};
+	context.graph = m_graph.get();
+	context.code = &code;
+	context.slots = &slots;
+	context.deferred_delays = &deferred_delays;
+	context.bits_override = bits_override;
+	context.quantize = quantize;
+
+	code.output_slots.reserve(sfg.output_count());
+	auto compiled_delays = std::size_t{0};
+	for (auto const i : range(sfg.output_count())) {
+		code.output_slots.push_back(sfg.compile_output(i, context));
+		// Compiling the input of a delay may reach further delays, which are appended to the same queue. Like in b_asic, the delays
+		// reached from an output are compiled before the next output.
+		for (; compiled_delays < deferred_delays.size(); ++compiled_delays) {
+			auto const [delay_instruction, src] = deferred_delays[compiled_delays];
+			ASIC_ASSERT(src);
+			auto const value = src->compile_output(context);
+			auto& delay = code.instructions[delay_instruction];
+			delay.operands[0] = value;
+			code.instructions.push_back(instruction{opcode::store_delay, no_slot, {value, no_slot, no_slot}, delay.index});
+		}
+	}
+
+	code.input_slots.reserve(sfg.inputs().size());
+	for (auto const input : sfg.inputs()) {
+		code.input_slots.push_back(m_graph->get<input_operation>(input).compiled_slot(context));
+	}
+
+	this->select_probes(code);
+	auto live_results = m_probed_results;
+	auto trigger_result = std::optional<std::size_t>{};
+	if (m_recording.mode == recording_mode::trigger) {
+		auto const it = std::find(code.result_keys.begin(), code.result_keys.end(), m_recording.trigger_key);
+		if (it == code.result_keys.end()) {
+			throw py::value_error{fmt::format("Simulation trigger result \"{}\" does not exist", m_recording.trigger_key)};
+		}
+		trigger_result = static_cast<std::size_t>(it - code.result_keys.begin());
+		live_results.push_back(*trigger_result);
+	}
+
+	m_optimization = optimize(code, live_results);
+	collapse_delay_chains(code);
+	schedule(code);
+	layout_values(code, m_block_size, m_lanes);
+	m_probed_offsets.clear();
+	for (auto const result : m_probed_results) {
+		m_probed_offsets.push_back(code.slot_offsets[code.result_slots[result]]);
+	}
+	m_trigger_offset.reset();
+	if (trigger_result) {
+		m_trigger_offset = code.slot_offsets[code.result_slots[*trigger_result]];
+	}
+
+	if (!supports_real_samples(code) && std::holds_alternative<simulation_state<real_number>>(m_state)) {
+		this->promote_to_complex();
+	}
+	std::visit(
+		[&](auto& state) {
+			using sample_type = typename std::decay_t<decltype(state.values)>::value_type;
+			// The traversal order does not depend on the quantization settings, so delay registers and result indices stay valid
+			// when recompiling.
+			if (state.delays.size() != code.delays.size() * m_lanes) {
+				state.delays.clear();
+				for (auto const& reg : code.delays) {
+					state.delays.insert(state.delays.end(), m_lanes, sample_cast<sample_type>(reg.initial_value));
+				}
+			}
+			state.values.assign(code.value_count, sample_type{});
+			if (state.results.empty()) {
+				state.results = recorder<sample_type>{m_recording, m_probed_results.size(), m_lanes};
+			}
+		},
+		m_state);
+	m_code = std::make_shared<program const>(std::move(code));
+	m_kernel = this->load_kernel(*m_code);
+	m_state_space = this->load_state_space(*m_code);
+	m_state_space_records = this->records_only_ports(*m_code);
+	m_output_selections.clear();
+	m_code_bits_override = bits_override;
+	m_code_quantize = quantize;
+	m_code_requires_python = requires_python(*m_code);
+}
+
+void simulation::select_probes(program const& code) {
+	m_probed_results.clear();
+	if (auto const* const name = std::get_if<std::string>(&m_probes)) {
+		if (*name == "all") {
+			m_probed_results.resize(code.result_keys.size());
+			std::iota(m_probed_results.begin(), m_probed_results.end(), std::size_t{0});
+			return;
+		}
+		// The outputs of the top-level graph are keyed by their index.
+		for (auto const i : range(code.output_slots.size())) {
+			auto const it = std::find(code.result_keys.begin(), code.result_keys.end(), fmt::to_string(i));
+			ASIC_ASSERT(it != code.result_keys.end());
+			m_probed_results.push_back(static_cast<std::size_t>(it - code.result_keys.begin()));
+		}
+		return;
+	}
+	auto const& patterns = std::get<std::vector<std::string>>(m_probes);
+	auto matched = std::vector<bool>(patterns.size());
+	for (auto&& [i, key] : enumerate(code.result_keys)) {
+		auto probed = false;
+		for (auto&& [j, pattern] : enumerate(patterns)) {
+			if (matches_probe(pattern, key)) {
+				matched[j] = true;
+				probed = true;
+			}
+		}
+		if (probed) {
+			m_probed_results.push_back(i);
+		}
+	}
+	for (auto&& [pattern, found] : zip(patterns, matched)) {
+		if (!found) {
+			throw py::value_error{fmt::format("Simulation probe \"{}\" does not match any result", pattern)};
+		}
+	}
+}
+
+simulation::output_selection const& simulation::select_outputs(std::vector<std::size_t> const& outputs, bool advance_delays, bool record) {
+	ASIC_ASSERT(m_code);
+	auto const it = std::find_if(m_output_selections.begin(), m_output_selections.end(), [&](output_selection const& selection) {
+		return selection.outputs == outputs && selection.advance_delays == advance_delays && selection.record == record;
+	});
+	if (it != m_output_selections.end()) {
+		return *it;
+	}
+	for (auto const output : outputs) {
+		if (output >= m_code->output_slots.size()) {
+			throw py::index_error{
+				fmt::format("Output index out of range (expected 0-{}, got {})", m_code->output_slots.size() - 1, output)};
+		}
+	}
+	ASIC_DEBUG_MSG("Selecting simulation outputs.");
+	// Saved and streamed results stay complete, so the probed results are evaluated along with the outputs.
+	auto live_results = std::vector<std::size_t>{};
+	auto trigger_result = std::optional<std::size_t>{};
+	if (record) {
+		live_results = m_probed_results;
+		if (m_recording.mode == recording_mode::trigger) {
+			auto const key = std::find(m_code->result_keys.begin(), m_code->result_keys.end(), m_recording.trigger_key);
+			ASIC_ASSERT(key != m_code->result_keys.end());
+			trigger_result = static_cast<std::size_t>(key - m_code->result_keys.begin());
+			live_results.push_back(*trigger_result);
+		}
+	}
+	auto code = output_cone(*m_code, outputs, live_results, advance_delays);
+	layout_values(code, m_block_size, m_lanes);
+
+	auto& selection = m_output_selections.emplace_back();
+	selection.outputs = outputs;
+	selection.advance_delays = advance_delays;
+	selection.record = record;
+	if (record) {
+		for (auto const result : m_probed_results) {
+			selection.probed_offsets.push_back(code.slot_offsets[code.result_slots[result]]);
+		}
+		if (trigger_result) {
+			selection.trigger_offset = code.slot_offsets[code.result_slots[*trigger_result]];
+		}
+	}
+	selection.requires_python = requires_python(code);
+	selection.native_kernel = this->load_kernel(code);
+	if (!record || this->records_only_ports(code)) {
+		selection.model = this->load_state_space(code);
+	}
+	selection.code = std::make_shared<program const>(std::move(code));
+	return selection;
+}
+
+std::shared_ptr<state_space_model const> simulation::load_state_space(program const& code) const {
+	if (!m_state_space_enabled) {
+		return nullptr;
+	}
+	auto model = extract_state_space(code);
+	return model ? std::make_shared<state_space_model const>(std::move(*model)) : nullptr;
+}
+
+bool simulation::records_only_ports(program const& code) const {
+	auto const is_port = [&](std::size_t result) {
+		auto const slot = code.result_slots[result];
+		return slot != no_slot && (std::find(code.input_slots.begin(), code.input_slots.end(), slot) != code.input_slots.end() ||
+								   std::find(code.output_slots.begin(), code.output_slots.end(), slot) != code.output_slots.end());
+	};
+	if (m_recording.mode == recording_mode::trigger) {
+		auto const it = std::find(code.result_keys.begin(), code.result_keys.end(), m_recording.trigger_key);
+		if (it == code.result_keys.end() || !is_port(static_cast<std::size_t>(it - code.result_keys.begin()))) {
+			return false;
+		}
+	}
+	return std::all_of(m_probed_results.begin(), m_probed_results.end(), is_port);
+}
+
+std::shared_ptr<kernel const> simulation::load_kernel(program const& code) const {
+	if (!m_kernel_options.enabled) {
+		return nullptr;
+	}
+	// Building a kernel runs the compiler, during which other Python threads can run.
+	auto const gil = py::gil_scoped_release{};
+	return asic::load_kernel(code, m_block_size, m_lanes, m_kernel_options);
+}
+
+void simulation::promote_to_complex() {
+	ASIC_DEBUG_MSG("Promoting simulation to complex samples.");
+	m_state = this->complex_state();
+}
+
+simulation_state<number> simulation::complex_state() const {
+	auto const& real_state = std::get<simulation_state<real_number>>(m_state);
+	if (real_state.stream) {
+		throw py::value_error{"Cannot switch to complex samples while streaming real-valued results"};
+	}
+	auto complex_state = simulation_state<number>{};
+	complex_state.values.assign(real_state.values.begin(), real_state.values.end());
+	complex_state.delays.assign(real_state.delays.begin(), real_state.delays.end());
+	complex_state.results = real_state.results.converted<number>();
+	return complex_state;
+}
+
 void simulation::clear_results() noexcept {
-	m_results.clear();
+	std::visit([](auto& state) { state.results.clear(); }, m_state);
 }
 
 void simulation::clear_state() noexcept {
-	m_delays.clear();
+	if (m_code) {
+		std::visit(
+			[&](auto& state) {
+				using sample_type = typename std::decay_t<decltype(state.values)>::value_type;
+				for (auto&& [i, reg] : enumerate(m_code->delays)) {
+					std::fill_n(state.delays.begin() + static_cast<std::ptrdiff_t>(i * m_lanes), m_lanes,
+								sample_cast<sample_type>(reg.initial_value));
+				}
+			},
+			m_state);
+	}
+}
+
+pybind11::bytes simulation::snapshot() {
+	if (!m_code) {
+		// The delay registers are the same for all settings, so use the ones of running without arguments.
+		this->compile(std::nullopt, true);
+	}
+	auto data = std::string{snapshot_magic};
+	write_value(data, m_iteration);
+	write_value(data, static_cast<std::uint64_t>(m_lanes));
+	std::visit(
+		[&](auto const& state) {
+			using sample_type = typename std::decay_t<decltype(state.values)>::value_type;
+			write_value(data, static_cast<std::uint8_t>(std::is_same_v<sample_type, number>));
+			write_value(data, static_cast<std::uint64_t>(state.delays.size()));
+			data.append(reinterpret_cast<char const*>(state.delays.data()), // NOLINT(cppcoreguidelines-pro-type-reinterpret-cast)
+						state.delays.size() * sizeof(sample_type));
+		},
+		m_state);
+	auto python_inputs = std::string{};
+	for (auto&& [i, generator] : enumerate(m_input_generators)) {
+		if (m_python_inputs[i] && !generator) {
+			python_inputs += fmt::format("{}{}", python_inputs.empty() ? "" : ", ", i);
+		}
+	}
+	if (!python_inputs.empty()) {
+		py::module_::import("warnings")
+			.attr("warn")(fmt::format("Simulation snapshot does not include the state of the Python input functions of inputs {}",
+									  python_inputs),
+						  py::module_::import("builtins").attr("RuntimeWarning"), 2);
+	}
+	write_value(data, static_cast<std::uint64_t>(m_input_generators.size()));
+	for (auto const& generator : m_input_generators) {
+		auto state = std::string{};
+		if (generator) {
+			generator->save_state(state);
+		}
+		write_value(data, static_cast<std::uint64_t>(state.size()));
+		data += state;
+	}
+	return py::bytes{data};
+}
+
+void simulation::restore(std::string_view snapshot) {
+	if (snapshot.substr(0, snapshot_magic.size()) != snapshot_magic) {
+		throw py::value_error{"Not a simulation snapshot"};
+	}
+	snapshot.remove_prefix(snapshot_magic.size());
+	auto const iteration = read_value<iteration_type>(snapshot);
+	auto const lanes = read_value<std::uint64_t>(snapshot);
+	if (lanes != m_lanes) {
+		throw py::value_error{fmt::format("Wrong number of lanes in simulation snapshot (expected {}, got {})", m_lanes, lanes)};
+	}
+	auto const is_complex = read_value<std::uint8_t>(snapshot) != 0;
+	auto const delay_count = read_value<std::uint64_t>(snapshot);
+	if (!m_code) {
+		this->compile(std::nullopt, true);
+	}
+	if (delay_count != m_code->delays.size() * m_lanes) {
+		throw py::value_error{fmt::format("Simulation snapshot does not match the graph (expected {} delay register values, got {})",
+										  m_code->delays.size() * m_lanes, delay_count)};
+	}
+	auto delays = std::vector<number>{};
+	if (is_complex) {
+		delays = read_values<number>(snapshot, static_cast<std::size_t>(delay_count));
+	} else {
+		auto const real_delays = read_values<real_number>(snapshot, static_cast<std::size_t>(delay_count));
+		delays.assign(real_delays.begin(), real_delays.end());
+	}
+	auto generator_states = std::vector<std::string_view>{};
+	auto const input_count = read_value<std::uint64_t>(snapshot);
+	if (input_count != m_input_generators.size()) {
+		throw py::value_error{fmt::format("Simulation snapshot does not match the graph (expected {} inputs, got {})",
+										  m_input_generators.size(), input_count)};
+	}
+	for (auto const i : range(m_input_generators.size())) {
+		auto const size = read_value<std::uint64_t>(snapshot);
+		if (snapshot.size() < size) {
+			throw py::value_error{"Simulation snapshot is truncated"};
+		}
+		if (size != 0 && !m_input_generators[i]) {
+			throw py::value_error{fmt::format("Simulation snapshot holds generator state for input {}, which has no native generator", i)};
+		}
+		generator_states.push_back(snapshot.substr(0, static_cast<std::size_t>(size)));
+		snapshot.remove_prefix(static_cast<std::size_t>(size));
+	}
+	if (!snapshot.empty()) {
+		throw py::value_error{"Simulation snapshot has trailing data"};
+	}
+
+	// Every generator state is read and checked, and the new state of the simulation is built, before anything is changed.
+	auto bit_generator_states = std::vector<generator_state>{};
+	for (auto&& [i, generator] : enumerate(m_input_generators)) {
+		auto state = generator_states[i];
+		if (generator) {
+			generator->read_state(state, bit_generator_states);
+		}
+		if (!state.empty()) {
+			throw py::value_error{fmt::format("Simulation snapshot does not match the generator of input {}", i)};
+		}
+	}
+	auto complex_state = std::optional<simulation_state<number>>{};
+	if (is_complex && std::holds_alternative<simulation_state<real_number>>(m_state)) {
+		complex_state = this->complex_state();
+	}
+	auto real_delays = std::vector<real_number>{};
+	if (!complex_state && std::holds_alternative<simulation_state<real_number>>(m_state)) {
+		real_delays.resize(delays.size());
+		std::transform(delays.begin(), delays.end(), real_delays.begin(), sample_cast<real_number>);
+	}
+	auto previous_states = std::vector<py::object>{};
+	previous_states.reserve(bit_generator_states.size());
+	for (auto const& [bit_generator, state] : bit_generator_states) {
+		previous_states.push_back(bit_generator.attr("state"));
+	}
+
+	// The generator states are assigned last, and put back if an assignment fails. The rest cannot fail.
+	for (auto const i : range(bit_generator_states.size())) {
+		try {
+			bit_generator_states[i].bit_generator.attr("state") = bit_generator_states[i].state;
+		} catch (...) {
+			for (auto const j : range(i)) {
+				bit_generator_states[i - 1 - j].bit_generator.attr("state") = previous_states[i - 1 - j];
+			}
+			throw;
+		}
+	}
+	if (complex_state) {
+		m_state = std::move(*complex_state);
+	}
+	if (auto* const state = std::get_if<simulation_state<number>>(&m_state)) {
+		state->delays.swap(delays);
+	} else {
+		std::get<simulation_state<real_number>>(m_state).delays.swap(real_delays);
+	}
+	m_iteration = iteration;
+}
+
+simulation simulation::fork() const {
+	return simulation{*this};
 }
 
 } // namespace asic
@@ -2,11 +2,21 @@
 #define ASIC_SIMULATION_OOP_HPP
 
 #include "../number.hpp"
+#include "../span.hpp"
 #include "core_operations.hpp"
 #include "custom_operation.hpp"
+#include "instruction.hpp"
+#include "kernel.hpp"
 #include "operation.hpp"
+#include "operation_graph.hpp"
+#include "optimize.hpp"
+#include "output_cone.hpp"
+#include "recording.hpp"
+#include "run.hpp"
 #include "signal_flow_graph.hpp"
+#include "signal_generator.hpp"
 #include "special_operations.hpp"
+#include "state_space.hpp"
 
 #define NOMINMAX
 #include <cstddef>
@@ -20,6 +30,7 @@
 #include <pybind11/numpy.h>
 #include <pybind11/pybind11.h>
 #include <pybind11/stl.h>
+#include <string>
 #include <string_view>
 #include <unordered_map>
 #include <utility>
@@ -28,38 +39,157 @@
 
 namespace asic {
 
-using iteration_type = std::uint32_t;
-using result_array_map = std::unordered_map<std::string, std::vector<number>>;
-using input_function_type = std::function<number(iteration_type)>;
-using input_provider_type = std::variant<number, std::vector<number>, input_function_type>;
+using input_function_type = pybind11::function;
+// Buffers, such as NumPy arrays of float64 or complex128 values, are read in place. They hold one value per iteration, or one row
+// of values per lane, and must not be resized while the simulation uses them.
+using input_provider_type =
+	std::variant<pybind11::buffer, number, std::vector<number>, std::vector<std::vector<number>>, input_function_type>;
+// Either "all", "outputs", or a list of graph IDs and shell-style wildcard patterns matched against result keys.
+using probe_set_type = std::variant<std::string, std::vector<std::string>>;
+// Fills the values of a block of iterations starting at the given one, interleaved by lane.
+using input_block_function_type = std::function<void(iteration_type, std::size_t, span<number>)>;
+
+template <typename T>
+struct simulation_state final {
+	std::vector<T> values{};
+	std::vector<T> delays{};
+	recorder<T> results{};
+	std::optional<result_stream<T>> stream{};
+};
 
 class simulation final {
 public:
-	simulation(pybind11::handle sfg, std::optional<std::vector<std::optional<input_provider_type>>> input_providers = std::nullopt);
+	static constexpr auto default_block_size = std::size_t{64};
+
+	simulation(pybind11::handle sfg, std::optional<std::vector<std::optional<input_provider_type>>> input_providers = std::nullopt,
+			   std::size_t block_size = default_block_size, std::size_t lanes = 1, probe_set_type probes = std::string{"all"},
+			   recording_policy recording = {}, kernel_options kernels = {}, bool state_space = false);
+	simulation(simulation&&) = default;
 
+	// Python input functions are called once per iteration, in the order of the inputs, unless they have an evaluate_block method
+	// taking the first iteration and the number of iterations of a block, which is called once per block instead.
+	// Generators from b_asic.signal_generator are evaluated natively, except for noise generators that draw from the same NumPy
+	// generator as another one, which are called once per iteration as well. If the graph has a Python operation without
+	// evaluate_output_block, the Python operations are called in the same order as by b_asic.Simulation, after the input functions
+	// of each iteration.
 	void set_input(std::size_t index, input_provider_type input_provider);
 	void set_inputs(std::vector<std::optional<input_provider_type>> input_providers);
 
-	[[nodiscard]] std::vector<number> step(bool save_results, std::optional<std::size_t> bits_override, bool quantize);
+	// When outputs are given, only those outputs are evaluated and returned, in the given order, along with the probed results if
+	// they are saved or streamed. Delays that none of them depend on keep their values unless advance_delays is set. With the
+	// state-space backend, linear programs are run by matrix products instead, as long as every probed result that is recorded is
+	// an input or an output.
+	[[nodiscard]] std::vector<number> step(bool save_results, std::optional<std::size_t> bits_override, bool quantize,
+										   std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays);
 	[[nodiscard]] std::vector<number> run_until(iteration_type iteration, bool save_results, std::optional<std::size_t> bits_override,
-												bool quantize);
+												bool quantize, std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays);
 	[[nodiscard]] std::vector<number> run_for(iteration_type iterations, bool save_results, std::optional<std::size_t> bits_override,
-											  bool quantize);
-	[[nodiscard]] std::vector<number> run(bool save_results, std::optional<std::size_t> bits_override, bool quantize);
+											  bool quantize, std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays);
+	[[nodiscard]] std::vector<number> run(bool save_results, std::optional<std::size_t> bits_override, bool quantize,
+										  std::optional<std::vector<std::size_t>> const& outputs, bool advance_delays);
 
 	[[nodiscard]] iteration_type iteration() const noexcept;
-	[[nodiscard]] pybind11::dict results() const noexcept;
+	[[nodiscard]] std::size_t lanes() const noexcept;
+	[[nodiscard]] std::optional<iteration_type> trigger_iteration() const noexcept;
+	[[nodiscard]] pybind11::dict results() const;
+	[[nodiscard]] pybind11::dict take_results();
+	// The number of operations in the graph and the memory they use, in total and per operation.
+	[[nodiscard]] pybind11::dict graph_statistics() const;
+	// The number of instructions that were folded into constants, merged with identical ones and pruned when compiling, the number
+	// that remain, and the keys of the results that are no longer evaluated since they are not probed.
+	[[nodiscard]] pybind11::dict optimization_statistics();
+
+	// Stream the probed results of every following iteration, whether saved or not, into memory-mapped .npy files that hold the
+	// given number of iterations. Returns the keys of the streamed results, in the order they are stored in a combined file.
+	std::vector<result_key> stream_results(std::string const& path, std::size_t iterations, bool combined);
+	void close_stream() noexcept;
 
 	void clear_results() noexcept;
 	void clear_state() noexcept;
 
+	// Save the delay registers, the iteration and the state of the native input generators in a binary blob, which restore() loads
+	// into this simulation or any other simulation of the same graph with the same number of lanes. Results, streams and the state
+	// of input functions that run in Python are not included, and snapshot() warns about such inputs. restore() checks the whole
+	// snapshot before changing anything, and leaves the simulation and its generators as they were if it fails.
+	[[nodiscard]] pybind11::bytes snapshot();
+	void restore(std::string_view snapshot);
+
+	// Make a simulation that shares the graph and the compiled program of this one and continues from a copy of its state, without
+	// any results. Native input generators get their own copies of their NumPy random number generators, while other Python input
+	// functions are shared.
+	[[nodiscard]] simulation fork() const;
+
 private:
-	signal_flow_graph_operation m_sfg{""};
-	result_array_map m_results{};
-	delay_map m_delays{};
+	// A program that only evaluates some of the outputs, made from the compiled program the first time they are requested.
+	struct output_selection final {
+		std::vector<std::size_t> outputs{};
+		bool advance_delays = false;
+		bool record = false;
+		std::shared_ptr<program const> code{};
+		std::shared_ptr<kernel const> native_kernel{};
+		std::shared_ptr<state_space_model const> model{};
+		bool requires_python = false;
+		std::vector<std::size_t> probed_offsets{};
+		std::optional<std::size_t> trigger_offset{};
+	};
+
+	// What a block is run with: the state-space model if there is one, otherwise the kernel, otherwise run_program.
+	struct block_program final {
+		program const* code = nullptr;
+		kernel const* native_kernel = nullptr;
+		state_space_model const* model = nullptr;
+		span<std::size_t const> probed_offsets{};
+		std::optional<std::size_t> trigger_offset{};
+	};
+
+	simulation(simulation const& other);
+
+	void compile(std::optional<std::size_t> bits_override, bool quantize);
+	[[nodiscard]] input_block_function_type make_buffer_input(pybind11::buffer const& buffer);
+	void check_input_length(std::size_t length);
+	void promote_to_complex();
+	[[nodiscard]] simulation_state<number> complex_state() const;
+	void select_probes(program const& code);
+	[[nodiscard]] output_selection const& select_outputs(std::vector<std::size_t> const& outputs, bool advance_delays, bool record);
+	[[nodiscard]] std::shared_ptr<kernel const> load_kernel(program const& code) const;
+	[[nodiscard]] std::shared_ptr<state_space_model const> load_state_space(program const& code) const;
+	void assign_input(std::size_t index, input_provider_type input_provider);
+	void share_noise();
+	[[nodiscard]] bool records_only_ports(program const& code) const;
+
+	template <typename T>
+	void run_block(simulation_state<T>& state, block_program const& block, std::size_t count, bool save_results);
+
+	std::shared_ptr<operation_graph const> m_graph{};
+	node_index m_sfg = 0;
+	std::shared_ptr<program const> m_code{};
+	std::optional<std::size_t> m_code_bits_override{};
+	bool m_code_quantize = false;
+	bool m_code_requires_python = false;
+	std::shared_ptr<kernel const> m_kernel{}; // Runs the program instead of run_program for real samples, if kernels are enabled.
+	kernel_options m_kernel_options;
+	std::shared_ptr<state_space_model const> m_state_space{};
+	bool m_state_space_records = false; // Whether the state-space model can be used while recording results.
+	bool m_state_space_enabled;
+	std::size_t m_block_size;
+	std::size_t m_lanes;
+	probe_set_type m_probes;
+	std::vector<std::size_t> m_probed_results{}; // Indices into the result tables of the program, in the order they are saved.
+	std::vector<std::size_t> m_probed_offsets{};
+	recording_policy m_recording;
+	std::optional<std::size_t> m_trigger_offset{};
+	optimization_report m_optimization{};
+	std::vector<output_selection> m_output_selections{};
+	std::variant<simulation_state<real_number>, simulation_state<number>> m_state{};
+	std::vector<number> m_input_values{};
 	iteration_type m_iteration = 0;
 	std::optional<iteration_type> m_input_length{};
-	std::vector<input_function_type> m_input_functions;
+	std::vector<input_block_function_type> m_input_functions; // Empty for the inputs that are read one iteration at a time.
+	// Python input functions without evaluate_block, which are called once per iteration in the order of the inputs.
+	std::vector<input_function_type> m_iteration_inputs;
+	std::vector<std::shared_ptr<signal_generator>> m_input_generators;
+	std::vector<input_function_type> m_generator_objects; // The Python generators of the inputs that have a native implementation.
+	std::vector<bool> m_python_inputs;
 };
 
 } // namespace asic
@@ -11,20 +11,28 @@ std::size_t input_operation::output_count() const noexcept {
 	return 1;
 }
 
-number input_operation::value() const noexcept {
-	return m_value;
+slot_index input_operation::compiled_slot(compilation_context const& context) const {
+	ASIC_ASSERT(context.slots);
+	if (auto const it = context.slots->find(this->key_of_output(0)); it != context.slots->end() && it->second) {
+		return *it->second;
+	}
+	return no_slot;
 }
 
-void input_operation::value(number value) noexcept {
-	m_value = value;
+std::optional<forwarded_signal> input_operation::forwarded_output(std::size_t index) const {
+	// Inputs of the top-level graph are not connected, and hold the input values instead.
+	if (!this->connected()) {
+		return std::nullopt;
+	}
+	return forwarded_signal{this->key_of_output(index), &this->input()};
 }
 
-number input_operation::evaluate_output_impl(std::size_t, evaluation_context const& context) const {
-	ASIC_DEBUG_MSG("Evaluating input.");
+slot_index input_operation::compile_output_impl(std::size_t, compilation_context const& context) const {
+	ASIC_DEBUG_MSG("Compiling input.");
 	if (this->connected()) {
-		return this->evaluate_input(context);
+		return this->compile_input(context);
 	}
-	return m_value;
+	return context.code->allocate_slot();
 }
 
 output_operation::output_operation(result_key key)
@@ -34,9 +42,13 @@ std::size_t output_operation::output_count() const noexcept {
 	return 1;
 }
 
-number output_operation::evaluate_output_impl(std::size_t, evaluation_context const& context) const {
-	ASIC_DEBUG_MSG("Evaluating output.");
-	return this->evaluate_input(context);
+std::optional<forwarded_signal> output_operation::forwarded_output(std::size_t index) const {
+	return forwarded_signal{this->key_of_output(index), &this->input()};
+}
+
+slot_index output_operation::compile_output_impl(std::size_t, compilation_context const& context) const {
+	ASIC_DEBUG_MSG("Compiling output.");
+	return this->compile_input(context);
 }
 
 delay_operation::delay_operation(result_key key, number initial_value)
@@ -47,32 +59,29 @@ std::size_t delay_operation::output_count() const noexcept {
 	return 1;
 }
 
-std::optional<number> delay_operation::current_output(std::size_t index, delay_map const& delays) const {
-	auto const key = this->key_of_output(index);
-	if (auto const it = delays.find(key); it != delays.end()) {
-		return it->second;
-	}
-	return m_initial_value;
-}
-
-number delay_operation::evaluate_output(std::size_t index, evaluation_context const& context) const {
-	ASIC_DEBUG_MSG("Evaluating delay.");
+slot_index delay_operation::compile_output(std::size_t index, compilation_context const& context) const {
+	ASIC_DEBUG_MSG("Compiling delay.");
 	ASIC_ASSERT(index == 0);
-	ASIC_ASSERT(context.results);
-	ASIC_ASSERT(context.delays);
+	ASIC_ASSERT(context.code);
+	ASIC_ASSERT(context.slots);
 	ASIC_ASSERT(context.deferred_delays);
 	auto key = this->key_of_output(index);
-	auto const value = context.delays->try_emplace(key, m_initial_value).first->second;
-	auto const& [it, inserted] = context.results->try_emplace(key, value);
-	if (inserted) {
-		context.deferred_delays->emplace_back(std::move(key), &this->input());
-		return value;
+	if (auto const it = context.slots->find(key); it != context.slots->end()) {
+		return it->second.value();
 	}
-	return it->second.value();
+	auto const reg = context.code->delays.size();
+	context.code->delays.push_back(delay_register{key, m_initial_value});
+	auto const slot = context.code->emit(opcode::delay, {no_slot, no_slot, no_slot}, static_cast<std::uint32_t>(reg));
+	context.slots->try_emplace(key, slot);
+	context.code->result_keys.push_back(std::move(key));
+	context.code->result_slots.push_back(slot);
+	// The input slot is filled in once the input has been compiled, since it may depend on this delay.
+	context.deferred_delays->emplace_back(context.code->instructions.size() - 1, &this->input());
+	return slot;
 }
 
-[[nodiscard]] number delay_operation::evaluate_output_impl(std::size_t, evaluation_context const&) const {
-	return number{};
+[[nodiscard]] slot_index delay_operation::compile_output_impl(std::size_t, compilation_context const&) const {
+	return no_slot;
 }
 
 } // namespace asic
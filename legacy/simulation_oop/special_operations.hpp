@@ -7,6 +7,7 @@
 
 #include <cassert>
 #include <cstddef>
+#include <optional>
 #include <utility>
 
 namespace asic {
@@ -16,13 +17,11 @@ public:
 	explicit input_operation(result_key key);
 
 	[[nodiscard]] std::size_t output_count() const noexcept final;
-	[[nodiscard]] number value() const noexcept;
-	void value(number value) noexcept;
+	[[nodiscard]] slot_index compiled_slot(compilation_context const& context) const;
+	[[nodiscard]] std::optional<forwarded_signal> forwarded_output(std::size_t index) const final;
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final;
-
-	number m_value{};
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final;
 };
 
 class output_operation final : public unary_operation {
@@ -30,9 +29,10 @@ public:
 	explicit output_operation(result_key key);
 
 	[[nodiscard]] std::size_t output_count() const noexcept final;
+	[[nodiscard]] std::optional<forwarded_signal> forwarded_output(std::size_t index) const final;
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final;
 };
 
 class delay_operation final : public unary_operation {
@@ -41,11 +41,10 @@ public:
 
 	[[nodiscard]] std::size_t output_count() const noexcept final;
 
-	[[nodiscard]] std::optional<number> current_output(std::size_t index, delay_map const& delays) const final;
-	[[nodiscard]] number evaluate_output(std::size_t index, evaluation_context const& context) const final;
+	[[nodiscard]] slot_index compile_output(std::size_t index, compilation_context const& context) const final;
 
 private:
-	[[nodiscard]] number evaluate_output_impl(std::size_t index, evaluation_context const& context) const final;
+	[[nodiscard]] slot_index compile_output_impl(std::size_t index, compilation_context const& context) const final;
 
 	number m_initial_value;
 };
@@ -0,0 +1,368 @@
+#include "state_space.hpp"
+
+#include "../algorithm.hpp"
+#include "../debug.hpp"
+
+#include <algorithm>
+#include <array>
+#include <type_traits>
+#include <utility>
+
+namespace asic {
+
+namespace {
+
+// The coefficients of the states, inputs and the constant one that a value is the sum of, ordered by variable.
+using linear_form = std::vector<std::pair<std::uint32_t, number>>;
+
+[[nodiscard]] linear_form combine(linear_form const& first, number first_scale, linear_form const& second, number second_scale) {
+	auto result = linear_form{};
+	result.reserve(first.size() + second.size());
+	auto const append = [&](std::uint32_t variable, number coefficient) {
+		if (coefficient != number{}) {
+			result.emplace_back(variable, coefficient);
+		}
+	};
+	auto i = first.begin();
+	auto j = second.begin();
+	while (i != first.end() || j != second.end()) {
+		if (j == second.end() || (i != first.end() && i->first < j->first)) {
+			append(i->first, first_scale * i->second);
+			++i;
+		} else if (i == first.end() || j->first < i->first) {
+			append(j->first, second_scale * j->second);
+			++j;
+		} else {
+			append(i->first, first_scale * i->second + second_scale * j->second);
+			++i;
+			++j;
+		}
+	}
+	return result;
+}
+
+[[nodiscard]] linear_form scale(linear_form const& form, number factor) {
+	return combine(form, factor, {}, number{});
+}
+
+[[nodiscard]] std::optional<number> constant_value(linear_form const& form, std::uint32_t one) {
+	if (form.empty()) {
+		return number{};
+	}
+	if (form.size() == 1 && form.front().first == one) {
+		return form.front().second;
+	}
+	return std::nullopt;
+}
+
+[[nodiscard]] std::optional<linear_form> evaluate_linear(program const& code, instruction const& instruction,
+														 std::array<linear_form const*, 3> const& operands, std::uint32_t one) {
+	if (instruction.type == opcode::constant) {
+		auto const value = code.constants[instruction.index];
+		return (value == number{}) ? linear_form{} : linear_form{{one, value}};
+	}
+	auto constants = std::array<std::optional<number>, 3>{};
+	auto all_constant = true;
+	for (auto&& [operand, constant] : zip(operands, constants)) {
+		if (operand) {
+			constant = constant_value(*operand, one);
+			all_constant = all_constant && constant.has_value();
+		}
+	}
+	if (all_constant) {
+		auto values = std::array<number, 3>{};
+		for (auto&& [constant, value] : zip(constants, values)) {
+			value = constant.value_or(number{});
+		}
+		if (auto const value = evaluate_constant(code, instruction, values)) {
+			return (*value == number{}) ? linear_form{} : linear_form{{one, *value}};
+		}
+		return std::nullopt;
+	}
+	auto const& [a, b, c] = operands;
+	auto const& [a_constant, b_constant, c_constant] = constants;
+	switch (instruction.type) {
+		case opcode::addition:
+			return combine(*a, number{1}, *b, number{1});
+		case opcode::subtraction:
+			return combine(*a, number{1}, *b, number{-1});
+		case opcode::multiplication:
+			if (a_constant) {
+				return scale(*b, *a_constant);
+			}
+			if (b_constant) {
+				return scale(*a, *b_constant);
+			}
+			return std::nullopt;
+		case opcode::division:
+			if (b_constant && *b_constant != number{}) {
+				return scale(*a, number{1} / *b_constant);
+			}
+			return std::nullopt;
+		case opcode::constant_multiplication:
+			return scale(*a, code.constants[instruction.index]);
+		case opcode::multiply_add:
+			if (a_constant) {
+				return combine(*b, *a_constant, *c, number{1});
+			}
+			if (b_constant) {
+				return combine(*a, *b_constant, *c, number{1});
+			}
+			return std::nullopt;
+		case opcode::symmetric_twoport_adaptor: {
+			auto const value = code.constants[instruction.index];
+			return combine(*c, number{1}, combine(*b, value, *a, -value), number{1});
+		}
+		default:
+			return std::nullopt;
+	}
+}
+
+// The variables from begin to end of each form become the columns of a matrix.
+[[nodiscard]] linear_map make_map(std::vector<linear_form> const& forms, std::uint32_t begin, std::uint32_t end) {
+	auto map = linear_map{};
+	map.rows = forms.size();
+	map.columns = end - begin;
+	auto const in_range = [&](auto const& term) {
+		return term.first >= begin && term.first < end;
+	};
+	auto nonzero = std::size_t{0};
+	for (auto const& form : forms) {
+		nonzero += static_cast<std::size_t>(std::count_if(form.begin(), form.end(), in_range));
+	}
+	map.sparse = nonzero * 4 < map.rows * map.columns;
+	if (map.sparse) {
+		map.row_starts.reserve(map.rows + 1);
+		for (auto const& form : forms) {
+			map.row_starts.push_back(map.values.size());
+			for (auto const& term : form) {
+				if (in_range(term)) {
+					map.column_indices.push_back(term.first - begin);
+					map.values.push_back(term.second);
+				}
+			}
+		}
+		map.row_starts.push_back(map.values.size());
+	} else {
+		map.values.assign(map.rows * map.columns, number{});
+		for (auto&& [row, form] : enumerate(forms)) {
+			for (auto const& term : form) {
+				if (in_range(term)) {
+					map.values[row * map.columns + (term.first - begin)] = term.second;
+				}
+			}
+		}
+	}
+	if (std::all_of(map.values.begin(), map.values.end(), [](number value) { return value.imag() == 0; })) {
+		map.real_values.reserve(map.values.size());
+		for (auto const value : map.values) {
+			map.real_values.push_back(value.real());
+		}
+	}
+	return map;
+}
+
+[[nodiscard]] std::vector<number> offsets(std::vector<linear_form> const& forms, std::uint32_t one) {
+	auto result = std::vector<number>(forms.size());
+	for (auto&& [value, form] : zip(result, forms)) {
+		if (!form.empty() && form.back().first == one) {
+			value = form.back().second;
+		}
+	}
+	return result;
+}
+
+template <typename T, typename Coefficient>
+void multiply_add(linear_map const& map, Coefficient const* coefficients, std::vector<T const*> const& x, std::size_t x_offset,
+				  std::vector<T*> const& y, std::size_t y_offset, std::size_t width) {
+	auto const accumulate = [&](std::size_t i, std::size_t j, Coefficient coefficient) {
+		auto* const row = y[i] + y_offset;
+		auto const* const input = x[j] + x_offset;
+		for (auto const w : range(width)) {
+			row[w] += coefficient * input[w];
+		}
+	};
+	if (map.sparse) {
+		for (auto const i : range(map.rows)) {
+			for (auto const k : range(map.row_starts[i], map.row_starts[i + 1])) {
+				accumulate(i, map.column_indices[k], coefficients[k]);
+			}
+		}
+		return;
+	}
+	for (auto const i : range(map.rows)) {
+		for (auto const j : range(map.columns)) {
+			if (auto const coefficient = coefficients[i * map.columns + j]; coefficient != Coefficient{}) {
+				accumulate(i, j, coefficient);
+			}
+		}
+	}
+}
+
+// y[i][offset + w] += M[i][j] x[j][offset + w] for every w below width, where x and y hold the rows of two matrices.
+template <typename T>
+void multiply_add(linear_map const& map, std::vector<T const*> const& x, std::size_t x_offset, std::vector<T*> const& y,
+				  std::size_t y_offset, std::size_t width) {
+	if constexpr (std::is_same_v<T, real_number>) {
+		ASIC_ASSERT(map.real_values.size() == map.values.size());
+		multiply_add(map, map.real_values.data(), x, x_offset, y, y_offset, width);
+	} else {
+		multiply_add(map, map.values.data(), x, x_offset, y, y_offset, width);
+	}
+}
+
+} // namespace
+
+std::optional<state_space_model> extract_state_space(program const& code) {
+	ASIC_ASSERT(code.slot_offsets.size() == code.slot_count);
+	auto model = state_space_model{};
+	auto const state_count = static_cast<std::uint32_t>(code.delays.size());
+	auto forms = std::vector<linear_form>(code.slot_count);
+	auto known = std::vector<bool>(code.slot_count, false);
+	auto input_count = std::uint32_t{0};
+	for (auto const slot : code.input_slots) {
+		if (slot != no_slot) {
+			forms[slot] = linear_form{{state_count + input_count++, number{1}}};
+			known[slot] = true;
+			model.input_offsets.push_back(code.slot_offsets[slot]);
+		}
+	}
+	auto const one = state_count + input_count;
+
+	// Within an iteration, delays only depend on the state, so their values are known before anything else is evaluated.
+	for (auto const& instruction : code.instructions) {
+		if (instruction.type == opcode::delay) {
+			forms[instruction.result] = linear_form{{instruction.index, number{1}}};
+			known[instruction.result] = true;
+		}
+	}
+	for (auto const& line : code.delay_lines) {
+		for (auto&& [k, tap] : enumerate(line.taps)) {
+			forms[tap] = linear_form{{static_cast<std::uint32_t>(line.first_register + line.taps.size() - 1 - k), number{1}}};
+			known[tap] = true;
+		}
+	}
+
+	auto next = std::vector<linear_form>(state_count);
+	for (auto const r : range(state_count)) {
+		next[r] = linear_form{{static_cast<std::uint32_t>(r), number{1}}};
+	}
+	for (auto const& instruction : code.instructions) {
+		switch (instruction.type) {
+			case opcode::delay:
+				break;
+			case opcode::store_delay:
+				ASIC_ASSERT(known[instruction.operands[0]]);
+				next[instruction.index] = forms[instruction.operands[0]];
+				break;
+			case opcode::delay_line: {
+				// The registers of a line shift by one each iteration, and the last one takes the source.
+				auto const& line = code.delay_lines[instruction.index];
+				auto const last = static_cast<std::uint32_t>(line.first_register + line.taps.size() - 1);
+				for (auto const r : range(line.first_register, last)) {
+					next[r] = linear_form{{static_cast<std::uint32_t>(r + 1), number{1}}};
+				}
+				ASIC_ASSERT(known[instruction.operands[0]]);
+				next[last] = forms[instruction.operands[0]];
+				break;
+			}
+			default: {
+				auto operands = std::array<linear_form const*, 3>{};
+				for (auto&& [slot, operand] : zip(instruction.operands, operands)) {
+					if (slot != no_slot) {
+						ASIC_ASSERT(known[slot]);
+						operand = &forms[slot];
+					}
+				}
+				auto form = evaluate_linear(code, instruction, operands, one);
+				if (!form) {
+					return std::nullopt;
+				}
+				forms[instruction.result] = std::move(*form);
+				known[instruction.result] = true;
+				break;
+			}
+		}
+	}
+
+	// Outputs that are inputs already hold their values, and outputs that share a slot are only written once.
+	auto written = std::vector<bool>(code.slot_count, false);
+	for (auto const slot : code.input_slots) {
+		if (slot != no_slot) {
+			written[slot] = true;
+		}
+	}
+	auto outputs = std::vector<linear_form>{};
+	outputs.reserve(code.output_slots.size());
+	for (auto const slot : code.output_slots) {
+		if (slot == no_slot || !known[slot]) {
+			return std::nullopt;
+		}
+		if (!written[slot]) {
+			written[slot] = true;
+			outputs.push_back(forms[slot]);
+			model.output_offsets.push_back(code.slot_offsets[slot]);
+		}
+	}
+	model.a = make_map(next, 0, state_count);
+	model.b = make_map(next, state_count, one);
+	model.c = make_map(outputs, 0, state_count);
+	model.d = make_map(outputs, state_count, one);
+	model.e = offsets(next, one);
+	model.f = offsets(outputs, one);
+	ASIC_DEBUG_MSG("Extracted state-space model of simulation program.");
+	return model;
+}
+
+template <typename T>
+void run_state_space(state_space_model const& model, span<T> values, span<T> delays, std::size_t lanes, std::size_t count) {
+	auto const state_count = model.a.rows;
+	auto const width = count * lanes;
+	ASIC_ASSERT(delays.size() == state_count * lanes);
+	auto inputs = std::vector<T const*>{};
+	inputs.reserve(model.input_offsets.size());
+	for (auto const offset : model.input_offsets) {
+		inputs.push_back(values.data() + offset);
+	}
+	auto outputs = std::vector<T*>{};
+	outputs.reserve(model.output_offsets.size());
+	for (auto&& [offset, value] : zip(model.output_offsets, model.f)) {
+		outputs.push_back(values.data() + offset);
+		std::fill_n(outputs.back(), width, sample_cast<T>(value));
+	}
+
+	// The inputs of a block are rows of the values, so what they contribute to every iteration takes one matrix product each.
+	auto driven = std::vector<T>(state_count * width);
+	auto driven_rows = std::vector<T*>{};
+	driven_rows.reserve(state_count);
+	for (auto&& [r, value] : enumerate(model.e)) {
+		driven_rows.push_back(driven.data() + r * width);
+		std::fill_n(driven_rows.back(), width, sample_cast<T>(value));
+	}
+	multiply_add(model.b, inputs, 0, driven_rows, 0, width);
+	multiply_add(model.d, inputs, 0, outputs, 0, width);
+
+	// The state of every lane is a column of a matrix, so each iteration multiplies that matrix.
+	auto next = std::vector<T>(state_count * lanes);
+	auto state_rows = std::vector<T const*>{};
+	auto next_rows = std::vector<T*>{};
+	state_rows.reserve(state_count);
+	next_rows.reserve(state_count);
+	for (auto const r : range(state_count)) {
+		state_rows.push_back(delays.data() + r * lanes);
+		next_rows.push_back(next.data() + r * lanes);
+	}
+	for (auto const n : range(count)) {
+		multiply_add(model.c, state_rows, 0, outputs, n * lanes, lanes);
+		for (auto const r : range(state_count)) {
+			std::copy_n(driven_rows[r] + n * lanes, lanes, next_rows[r]);
+		}
+		multiply_add(model.a, state_rows, 0, next_rows, 0, lanes);
+		std::copy(next.begin(), next.end(), delays.begin());
+	}
+}
+
+template void run_state_space<real_number>(state_space_model const&, span<real_number>, span<real_number>, std::size_t, std::size_t);
+template void run_state_space<number>(state_space_model const&, span<number>, span<number>, std::size_t, std::size_t);
+
+} // namespace asic
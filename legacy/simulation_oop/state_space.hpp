@@ -0,0 +1,53 @@
+#ifndef ASIC_SIMULATION_STATE_SPACE_HPP
+#define ASIC_SIMULATION_STATE_SPACE_HPP
+
+#include "../number.hpp"
+#include "../span.hpp"
+#include "instruction.hpp"
+#include "run.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+namespace asic {
+
+// A matrix, stored densely or, when most of its entries are zero, as the nonzero entries of each row.
+struct linear_map final {
+	std::size_t rows = 0;
+	std::size_t columns = 0;
+	bool sparse = false;
+	std::vector<number> values{};
+	std::vector<real_number> real_values{}; // The same values, if none of them is complex.
+	std::vector<std::uint32_t> column_indices{}; // Of each value when sparse.
+	std::vector<std::size_t> row_starts{};       // Where each row starts in the values when sparse, followed by the value count.
+};
+
+// The affine state-space form of a program, over its delay registers and the inputs that it uses:
+//   x[n + 1] = A x[n] + B u[n] + e
+//   y[n] = C x[n] + D u[n] + f
+// Delay registers that the program does not update, like those outside the cone of selected outputs, keep their values.
+struct state_space_model final {
+	linear_map a{};
+	linear_map b{};
+	linear_map c{};
+	linear_map d{};
+	std::vector<number> e{};
+	std::vector<number> f{};
+	std::vector<std::size_t> input_offsets{}; // Where each input of the model starts in the values.
+	// Where each output of the model starts in the values. These are the distinct outputs of the program that are not inputs.
+	std::vector<std::size_t> output_offsets{};
+};
+
+// Extract the state-space form of a laid out program. Returns nothing if the program is not linear in its delays and inputs, for
+// example if it quantizes, compares or calls Python, or multiplies two values that are not constant.
+[[nodiscard]] std::optional<state_space_model> extract_state_space(program const& code);
+
+// Evaluate the first count iterations of a block like run_program, but only write the outputs of the program.
+template <typename T>
+void run_state_space(state_space_model const& model, span<T> values, span<T> delays, std::size_t lanes, std::size_t count);
+
+} // namespace asic
+
+#endif // ASIC_SIMULATION_STATE_SPACE_HPP
@@ -0,0 +1,216 @@
+#ifndef ASIC_SPAN_HPP
+#define ASIC_SPAN_HPP
+
+#include <array>
+#include <cstddef>
+#include <iterator>
+#include <limits>
+#include <type_traits>
+#include <utility>
+
+namespace asic {
+
+constexpr auto dynamic_size = std::numeric_limits<std::size_t>::max();
+
+// A view of a contiguous sequence of elements, like std::span in C++20.
+template <typename T, std::size_t Size = dynamic_size>
+class span;
+
+namespace detail {
+
+template <typename T>
+struct is_span : std::false_type {};
+
+template <typename T, std::size_t Size>
+struct is_span<span<T, Size>> : std::true_type {};
+
+template <typename T>
+struct is_std_array : std::false_type {};
+
+template <typename T, std::size_t Size>
+struct is_std_array<std::array<T, Size>> : std::true_type {};
+
+template <typename Container, typename = void>
+struct has_data_and_size : std::false_type {};
+
+template <typename Container>
+struct has_data_and_size<Container, std::void_t<decltype(std::data(std::declval<Container>())), decltype(std::size(std::declval<Container>()))>>
+	: std::true_type {};
+
+// Containers whose elements can be viewed by a span of Element.
+template <typename Container, typename Element>
+constexpr auto is_compatible_container = !is_span<std::remove_cv_t<std::remove_reference_t<Container>>>::value &&
+	!is_std_array<std::remove_cv_t<std::remove_reference_t<Container>>>::value &&
+	!std::is_array_v<std::remove_reference_t<Container>> && has_data_and_size<Container>::value &&
+	std::is_convertible_v<std::remove_pointer_t<decltype(std::data(std::declval<Container&>()))> (*)[], Element (*)[]>;
+
+template <typename T, std::size_t Size>
+struct span_storage {
+	constexpr span_storage() noexcept = default;
+
+	constexpr span_storage(T* pointer, std::size_t) noexcept
+		: data(pointer) {}
+
+	T* data = nullptr;
+	static constexpr std::size_t size = Size;
+};
+
+template <typename T>
+struct span_storage<T, dynamic_size> {
+	constexpr span_storage() noexcept = default;
+
+	constexpr span_storage(T* pointer, std::size_t count) noexcept
+		: data(pointer)
+		, size(count) {}
+
+	T* data = nullptr;
+	std::size_t size = 0;
+};
+
+} // namespace detail
+
+template <typename T, std::size_t Size>
+class span final {
+public:
+	using element_type = T;
+	using value_type = std::remove_cv_t<T>;
+	using size_type = std::size_t;
+	using difference_type = std::ptrdiff_t;
+	using pointer = T*;
+	using const_pointer = T const*;
+	using reference = T&;
+	using const_reference = T const&;
+	using iterator = T*;
+	using reverse_iterator = std::reverse_iterator<iterator>;
+
+	static constexpr size_type extent = Size;
+
+	template <std::size_t S = Size, std::enable_if_t<S == 0 || S == dynamic_size, int> = 0>
+	constexpr span() noexcept {}
+
+	constexpr span(pointer first, size_type count)
+		: m_storage(first, count) {}
+
+	constexpr span(pointer first, pointer last)
+		: m_storage(first, static_cast<size_type>(last - first)) {}
+
+	template <std::size_t N, std::enable_if_t<Size == dynamic_size || N == Size, int> = 0>
+	constexpr span(element_type (&array)[N]) noexcept // NOLINT(google-explicit-constructor)
+		: m_storage(array, N) {}
+
+	template <typename U, std::size_t N,
+			  std::enable_if_t<(Size == dynamic_size || N == Size) && std::is_convertible_v<U (*)[], T (*)[]>, int> = 0>
+	constexpr span(std::array<U, N>& array) noexcept // NOLINT(google-explicit-constructor)
+		: m_storage(array.data(), N) {}
+
+	template <typename U, std::size_t N,
+			  std::enable_if_t<(Size == dynamic_size || N == Size) && std::is_convertible_v<U const (*)[], T (*)[]>, int> = 0>
+	constexpr span(std::array<U, N> const& array) noexcept // NOLINT(google-explicit-constructor)
+		: m_storage(array.data(), N) {}
+
+	template <typename Container, std::enable_if_t<Size == dynamic_size && detail::is_compatible_container<Container&, T>, int> = 0>
+	constexpr span(Container& container) // NOLINT(google-explicit-constructor)
+		: m_storage(std::data(container), std::size(container)) {}
+
+	template <typename Container,
+			  std::enable_if_t<Size == dynamic_size && detail::is_compatible_container<Container const&, T>, int> = 0>
+	constexpr span(Container const& container) // NOLINT(google-explicit-constructor)
+		: m_storage(std::data(container), std::size(container)) {}
+
+	template <typename U, std::size_t N,
+			  std::enable_if_t<(Size == dynamic_size || Size == N) && std::is_convertible_v<U (*)[], T (*)[]>, int> = 0>
+	constexpr span(span<U, N> const& other) noexcept // NOLINT(google-explicit-constructor)
+		: m_storage(other.data(), other.size()) {}
+
+	constexpr span(span const& other) noexcept = default;
+	constexpr span& operator=(span const& other) noexcept = default;
+	~span() = default;
+
+	template <std::size_t Count>
+	[[nodiscard]] constexpr span<T, Count> first() const {
+		return span<T, Count>{this->data(), Count};
+	}
+
+	template <std::size_t Count>
+	[[nodiscard]] constexpr span<T, Count> last() const {
+		return span<T, Count>{this->data() + (this->size() - Count), Count};
+	}
+
+	[[nodiscard]] constexpr span<T> first(size_type count) const {
+		return span<T>{this->data(), count};
+	}
+
+	[[nodiscard]] constexpr span<T> last(size_type count) const {
+		return span<T>{this->data() + (this->size() - count), count};
+	}
+
+	[[nodiscard]] constexpr span<T> subspan(size_type offset, size_type count = dynamic_size) const {
+		return span<T>{this->data() + offset, (count == dynamic_size) ? this->size() - offset : count};
+	}
+
+	[[nodiscard]] constexpr size_type size() const noexcept {
+		return m_storage.size;
+	}
+
+	[[nodiscard]] constexpr size_type size_bytes() const noexcept {
+		return this->size() * sizeof(element_type);
+	}
+
+	[[nodiscard]] constexpr bool empty() const noexcept {
+		return this->size() == 0;
+	}
+
+	[[nodiscard]] constexpr reference operator[](size_type i) const {
+		return this->data()[i];
+	}
+
+	[[nodiscard]] constexpr reference front() const {
+		return *this->data();
+	}
+
+	[[nodiscard]] constexpr reference back() const {
+		return this->data()[this->size() - 1];
+	}
+
+	[[nodiscard]] constexpr pointer data() const noexcept {
+		return m_storage.data;
+	}
+
+	[[nodiscard]] constexpr iterator begin() const noexcept {
+		return this->data();
+	}
+
+	[[nodiscard]] constexpr iterator end() const noexcept {
+		return this->data() + this->size();
+	}
+
+	[[nodiscard]] constexpr reverse_iterator rbegin() const noexcept {
+		return reverse_iterator{this->end()};
+	}
+
+	[[nodiscard]] constexpr reverse_iterator rend() const noexcept {
+		return reverse_iterator{this->begin()};
+	}
+
+private:
+	detail::span_storage<T, Size> m_storage{};
+};
+
+template <typename T, std::size_t N>
+span(T (&)[N]) -> span<T, N>;
+
+template <typename T, std::size_t N>
+span(std::array<T, N>&) -> span<T, N>;
+
+template <typename T, std::size_t N>
+span(std::array<T, N> const&) -> span<T const, N>;
+
+template <typename Container>
+span(Container&) -> span<typename Container::value_type>;
+
+template <typename Container>
+span(Container const&) -> span<typename Container::value_type const>;
+
+} // namespace asic
+
+#endif // ASIC_SPAN_HPP
@@ -0,0 +1,906 @@
+"""
+B-ASIC test suite for the C++ simulation engine in legacy/simulation_oop.
+
+The native engine is compared against :class:`b_asic.simulation.Simulation`, which
+evaluates the SFG one iteration at a time. The tests are skipped when the ``_b_asic``
+extension module built from legacy/simulation_oop cannot be imported, unless
+B_ASIC_REQUIRE_EXTENSION is set, as it is when the tests are run by ctest.
+"""
+
+import os
+import shutil
+
+import numpy as np
+import pytest
+
+from b_asic import (
+    MAD,
+    SFG,
+    Addition,
+    AddSub,
+    ConstantMultiplication,
+    Input,
+    LeftShift,
+    Multiplication,
+    Output,
+    Reciprocal,
+    RightShift,
+    Shift,
+    Simulation,
+    Sink,
+    SymmetricTwoportAdaptor,
+)
+from b_asic.core_operations import Constant as ConstantOperation
+from b_asic.operation import AbstractOperation
+from b_asic.quantization import Overflow, Quantization, quantize
+from b_asic.signal_generator import (
+    Constant,
+    Delay,
+    Downsample,
+    Gaussian,
+    Impulse,
+    Sinusoid,
+    Step,
+    Uniform,
+    Upsample,
+    ZeroPad,
+    _counter_uniforms,
+)
+from b_asic.special_operations import Delay as DelayElement
+
+if os.environ.get("B_ASIC_REQUIRE_EXTENSION"):
+    import _b_asic
+else:
+    _b_asic = pytest.importorskip("_b_asic")
+
+SFG_FIXTURES = [
+    "sfg_two_inputs_two_outputs",
+    "sfg_nested",
+    "sfg_delay",
+    "sfg_accumulator",
+    "sfg_simple_accumulator",
+    "sfg_simple_filter",
+    "sfg_custom_operation",
+    "sfg_two_tap_fir",
+    "sfg_direct_form_iir_lp_filter",
+]
+
+LINEAR_SFG_FIXTURES = [
+    "sfg_two_inputs_two_outputs",
+    "sfg_delay",
+    "sfg_simple_accumulator",
+    "sfg_simple_filter",
+    "sfg_two_tap_fir",
+    "sfg_direct_form_iir_lp_filter",
+]
+
+ITERATIONS = 150
+
+
+def make_inputs(sfg, iterations=ITERATIONS, seed=0):
+    rng = np.random.default_rng(seed)
+    return [rng.uniform(-1, 1, iterations) for _ in range(sfg.input_count)]
+
+
+def reference_results(sfg, input_providers, iterations=ITERATIONS):
+    simulation = Simulation(sfg, input_providers)
+    simulation.run_for(iterations)
+    return simulation.results
+
+
+def assert_results_equal(results, reference, keys=None):
+    for key in reference.keys() if keys is None else keys:
+        assert key in results
+        assert np.array_equal(results[key], reference[key]), key
+
+
+def assert_outputs_equal(sfg, results, reference):
+    assert_results_equal(results, reference, [str(i) for i in range(sfg.output_count)])
+
+
+class TestInterpreter:
+    @pytest.mark.parametrize("fixture", SFG_FIXTURES)
+    @pytest.mark.parametrize("block_size", [1, 7, 64])
+    def test_matches_simulation(self, request, fixture, block_size):
+        sfg = request.getfixturevalue(fixture)
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs, block_size=block_size)
+        output = simulation.run_for(ITERATIONS)
+
+        assert simulation.iteration == ITERATIONS
+        assert_results_equal(simulation.results, reference)
+        for i, value in enumerate(output):
+            assert value == reference[str(i)][-1]
+
+    def test_lambdas_as_input(self, sfg_two_inputs_two_outputs):
+        inputs = [lambda n: n + 3, lambda n: 1 + n * 2]
+        reference = reference_results(sfg_two_inputs_two_outputs, inputs, 101)
+
+        simulation = _b_asic.Simulation(sfg_two_inputs_two_outputs, inputs)
+        simulation.run_for(101)
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_shared_input_function(self, sfg_two_inputs_two_outputs):
+        def make_counter(calls):
+            def counter(n):
+                calls.append(n)
+                return len(calls)
+
+            return counter
+
+        reference_calls = []
+        counter = make_counter(reference_calls)
+        reference = reference_results(
+            sfg_two_inputs_two_outputs, [counter, counter], 100
+        )
+
+        calls = []
+        counter = make_counter(calls)
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, [counter, counter], block_size=16
+        )
+        simulation.run_for(100)
+
+        assert calls == reference_calls
+        assert_results_equal(simulation.results, reference)
+
+    def test_block_input_function(self, sfg_delay):
+        class Ramp:
+            def __init__(self):
+                self.blocks = []
+
+            def __call__(self, n):
+                return n
+
+            def evaluate_block(self, start, count):
+                self.blocks.append((start, count))
+                return np.arange(start, start + count, dtype=float)
+
+        ramp = Ramp()
+        reference = reference_results(sfg_delay, [ramp], 100)
+
+        ramp.blocks.clear()
+        simulation = _b_asic.Simulation(sfg_delay, [ramp], block_size=64)
+        simulation.run_for(100)
+
+        assert ramp.blocks == [(0, 64), (64, 36)]
+        assert_results_equal(simulation.results, reference)
+
+    def test_python_operation_call_order(self):
+        calls = []
+
+        class Recorder(AbstractOperation):
+            def __init__(self, src0=None, name=""):
+                super().__init__(
+                    input_count=1, output_count=1, name=name, input_sources=[src0]
+                )
+
+            @classmethod
+            def type_name(cls):
+                return "recorder"
+
+            def evaluate(self, a):
+                calls.append(self.name)
+                return a + len(calls)
+
+        class BlockRecorder(Recorder):
+            def evaluate_output_block(self, index, input_values, quantize=True):
+                calls.append(f"{self.name} block")
+                return input_values[0] + len(calls)
+
+        def counter(n):
+            calls.append("input")
+            return len(calls)
+
+        in1 = Input()
+        b = Recorder(DelayElement(Recorder(in1, "d"), 1.5), "b")
+        c = BlockRecorder(in1, "c")
+        sfg = SFG(inputs=[in1], outputs=[Output(b), Output(c)])
+        reference = reference_results(sfg, [counter], 100)
+        reference_calls = list(calls)
+
+        # One operation without evaluate_output_block makes all of them be called
+        # once per iteration, interleaved with the input functions.
+        calls.clear()
+        simulation = _b_asic.Simulation(sfg, [counter], block_size=16)
+        simulation.run_for(100)
+
+        assert reference_calls[:4] == ["input", "b", "d", "c"]
+        assert calls == reference_calls
+        assert_results_equal(simulation.results, reference)
+
+    @pytest.mark.parametrize(
+        "make_providers",
+        [
+            lambda: [Impulse(3), Step(5)],
+            lambda: [Sinusoid(0.1, 0.5), ZeroPad([1, 2, 3]) * 2],
+            lambda: [Upsample([1, 2, 3], 3, 1), Downsample(Step(10), 2) - 0.5],
+            lambda: [Constant(1.5) + Delay(Impulse(), 4), Constant(2) / Constant(3)],
+            lambda: [Gaussian(4), Uniform(5)],
+        ],
+    )
+    @pytest.mark.parametrize("block_size", [1, 64])
+    def test_signal_generators(
+        self, sfg_two_inputs_two_outputs, make_providers, block_size
+    ):
+        reference = reference_results(sfg_two_inputs_two_outputs, make_providers())
+
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, make_providers(), block_size=block_size
+        )
+        simulation.run_for(ITERATIONS)
+
+        assert_results_equal(simulation.results, reference)
+
+    @pytest.mark.parametrize(
+        "make_providers",
+        [
+            lambda: [Gaussian(1)] * 2,
+            lambda: (lambda g: [g, Delay(g, 2)])(Uniform(2)),
+            lambda: (lambda g: [g + Delay(g), Constant(1.0)])(Gaussian(3)),
+        ],
+    )
+    def test_noise_generators(self, sfg_two_inputs_two_outputs, make_providers):
+        reference = reference_results(sfg_two_inputs_two_outputs, make_providers())
+
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, make_providers(), block_size=64
+        )
+        simulation.run_for(ITERATIONS)
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_noise_generator_shared_later(self, sfg_two_inputs_two_outputs):
+        def run(simulation):
+            g = Gaussian(1)
+            simulation.set_input(0, g)
+            simulation.run_for(70)
+            simulation.set_input(1, g)
+            simulation.run_for(80)
+            return simulation.results
+
+        reference = run(Simulation(sfg_two_inputs_two_outputs, [0, 0]))
+        results = run(_b_asic.Simulation(sfg_two_inputs_two_outputs, [0, 0]))
+
+        assert_results_equal(results, reference)
+
+    @pytest.mark.parametrize(
+        "make_providers",
+        [
+            lambda: [
+                Uniform(7, counter_based=True),
+                Uniform(7, counter_based=True, stream=1),
+            ],
+            lambda: (lambda g: [g, Delay(g, 3)])(Gaussian(8, counter_based=True)),
+        ],
+    )
+    @pytest.mark.parametrize("block_size", [1, 7, 64])
+    def test_counter_based_noise(
+        self, sfg_two_inputs_two_outputs, make_providers, block_size
+    ):
+        reference = reference_results(sfg_two_inputs_two_outputs, make_providers())
+
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, make_providers(), block_size=block_size
+        )
+        simulation.run_for(ITERATIONS)
+
+        assert_results_equal(simulation.results, reference)
+
+    @pytest.mark.parametrize("stream", [0, 1, 2**32 + 5, 2**64 - 1])
+    @pytest.mark.parametrize("block_size", [1, 7, 64])
+    @pytest.mark.parametrize("lanes", [1, 3])
+    def test_counter_uniforms(self, sfg_delay, stream, block_size, lanes):
+        # A uniform generator from 0 to 1 gives the first value of the stream exactly.
+        seed = 2**40 + 17
+        uniform = Uniform(seed, 0, 1, counter_based=True, stream=stream)
+        simulation = _b_asic.Simulation(
+            sfg_delay, [uniform], block_size=block_size, lanes=lanes
+        )
+        simulation.run_for(ITERATIONS)
+
+        expected = [_counter_uniforms(seed, stream, n)[0] for n in range(ITERATIONS)]
+        values = simulation.results["in0"].reshape(lanes, ITERATIONS)
+        for lane in values:
+            assert lane.tolist() == expected
+
+    def test_lists_as_input(self, sfg_accumulator):
+        inputs = [[5, 9, 25, -5, 7], [0, 0, 1, 0, 0]]
+        reference = reference_results(sfg_accumulator, inputs, 5)
+
+        simulation = _b_asic.Simulation(sfg_accumulator, inputs)
+        simulation.run()
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_split_runs(self, sfg_direct_form_iir_lp_filter):
+        inputs = make_inputs(sfg_direct_form_iir_lp_filter)
+        reference = reference_results(sfg_direct_form_iir_lp_filter, inputs)
+
+        simulation = _b_asic.Simulation(sfg_direct_form_iir_lp_filter, inputs)
+        simulation.step()
+        simulation.run_for(40)
+        simulation.run_until(ITERATIONS)
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_complex_input(self, sfg_simple_filter):
+        inputs = [make_inputs(sfg_simple_filter)[0] * (1 + 2j)]
+        reference = reference_results(sfg_simple_filter, inputs)
+
+        simulation = _b_asic.Simulation(sfg_simple_filter, inputs)
+        simulation.run()
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_clear_state(self, sfg_direct_form_iir_lp_filter):
+        def run(simulation):
+            simulation.run_for(60)
+            simulation.clear_state()
+            simulation.run_for(40)
+            results = simulation.results
+            simulation.clear_results()
+            simulation.run()
+            return results, simulation.results
+
+        inputs = make_inputs(sfg_direct_form_iir_lp_filter)
+        reference = run(Simulation(sfg_direct_form_iir_lp_filter, inputs))
+        results = run(_b_asic.Simulation(sfg_direct_form_iir_lp_filter, inputs))
+
+        for result, expected in zip(results, reference):
+            assert_results_equal(result, expected)
+
+    def test_real_samples(self, sfg_simple_filter):
+        real_inputs = make_inputs(sfg_simple_filter)
+        complex_inputs = [real_inputs[0] * 1j]
+
+        real = _b_asic.Simulation(sfg_simple_filter, real_inputs)
+        real.run()
+        complex_ = _b_asic.Simulation(sfg_simple_filter, complex_inputs)
+        complex_.run()
+
+        assert real.results["0"].dtype == np.float64
+        assert complex_.results["0"].dtype == np.complex128
+        assert_results_equal(
+            real.results, reference_results(sfg_simple_filter, real_inputs)
+        )
+        assert_results_equal(
+            complex_.results, reference_results(sfg_simple_filter, complex_inputs)
+        )
+
+    @pytest.mark.parametrize("dtype", [np.float64, np.complex128])
+    def test_strided_buffer_input(self, sfg_simple_filter, dtype):
+        values = make_inputs(sfg_simple_filter, 3 * ITERATIONS)[0].astype(dtype)
+        inputs = [values[::3]]
+        reference = reference_results(sfg_simple_filter, inputs)
+
+        simulation = _b_asic.Simulation(sfg_simple_filter, inputs, block_size=16)
+        simulation.run()
+
+        assert_results_equal(simulation.results, reference)
+
+    def test_buffer_too_short(self, sfg_delay):
+        simulation = _b_asic.Simulation(sfg_delay, [np.zeros(10)])
+        with pytest.raises(IndexError):
+            simulation.run_for(11)
+
+
+@pytest.fixture
+def sfg_core_operations():
+    """SFG with the core operations that have no other tests in this file."""
+    in1 = Input("IN1")
+    in2 = Input("IN2")
+    in3 = Input("IN3")
+    add = AddSub(True, in1, in2, "ADDSUB1")
+    sub = AddSub(False, in2, in3, "ADDSUB2")
+    mad = MAD(add, sub, in3, "MAD1")
+    adaptor = SymmetricTwoportAdaptor(0.375, mad, in1, "SYM1")
+    reciprocal = Reciprocal(Shift(-1, in3, "SHIFT1"), "REC1")
+    shifted = LeftShift(3, RightShift(2, adaptor.output(1), "RSHIFT1"), "LSHIFT1")
+    sink = Sink("SINK1")
+    sink.input(0).connect(Shift(2, reciprocal, "SHIFT2"))
+    out1 = Output(adaptor.output(0), "OUT1")
+    out2 = Output(reciprocal, "OUT2")
+    out3 = Output(shifted, "OUT3")
+    return SFG(inputs=[in1, in2, in3], outputs=[out1, out2, out3])
+
+
+class TestCoreOperations:
+    @pytest.mark.parametrize("block_size", [1, 64])
+    def test_real_samples(self, sfg_core_operations, block_size):
+        # The reciprocal is taken of half of the third input.
+        rng = np.random.default_rng(0)
+        inputs = [rng.uniform(1, 2, ITERATIONS) for _ in range(3)]
+        reference = reference_results(sfg_core_operations, inputs)
+
+        simulation = _b_asic.Simulation(
+            sfg_core_operations, inputs, block_size=block_size
+        )
+        simulation.run()
+
+        assert simulation.results["0"].dtype == np.float64
+        assert_results_equal(simulation.results, reference)
+        assert not any(key.startswith("sink") for key in simulation.results)
+
+    @pytest.mark.parametrize("block_size", [1, 64])
+    def test_complex_samples(self, sfg_core_operations, block_size):
+        # Python complex numbers, which are divided like in C++, unlike NumPy ones.
+        rng = np.random.default_rng(0)
+        inputs = [
+            [complex(rng.uniform(1, 2), rng.uniform(-1, 1)) for _ in range(ITERATIONS)]
+            for _ in range(3)
+        ]
+        reference = reference_results(sfg_core_operations, inputs)
+
+        simulation = _b_asic.Simulation(
+            sfg_core_operations, inputs, block_size=block_size
+        )
+        simulation.run()
+
+        assert simulation.results["0"].dtype == np.complex128
+        assert_results_equal(simulation.results, reference)
+        assert not any(key.startswith("sink") for key in simulation.results)
+
+
+def make_delay_chain(feedback):
+    """SFG of an FIR filter with 12 delays in a chain, optionally fed back into it."""
+    in1 = Input("IN1")
+    head = Addition(in1, None, "ADD0") if feedback else in1
+    taps = [head]
+    for i in range(12):
+        taps.append(DelayElement(taps[-1], 0.5 if i == 5 else 0, f"T{i}"))
+    total = ConstantMultiplication(0.5, head)
+    for i, tap in enumerate(taps[1:], 1):
+        total = Addition(total, ConstantMultiplication(1 / (i + 1), tap))
+    if feedback:
+        head.input(1).connect(ConstantMultiplication(-0.25, taps[-1]))
+    return SFG(inputs=[in1], outputs=[Output(total, "OUT1")])
+
+
+class TestDelayLines:
+    @pytest.mark.parametrize("feedback", [False, True])
+    @pytest.mark.parametrize("block_size", [1, 5, 64])
+    def test_matches_simulation(self, feedback, block_size):
+        sfg = make_delay_chain(feedback)
+        middle = sfg.find_by_name("T5")[0].graph_id
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(
+            sfg, inputs, block_size=block_size, probes=["0", middle]
+        )
+        simulation.run_for(40)
+        simulation.run()
+
+        assert set(simulation.results) == {"0", middle}
+        assert simulation.results[middle][0] == 0.5
+        assert_results_equal(simulation.results, reference, ["0", middle])
+
+
+class TestFixedPoint:
+    @pytest.mark.parametrize("quantization", list(Quantization))
+    @pytest.mark.parametrize("overflow", list(Overflow))
+    def test_matches_quantize(self, quantization, overflow):
+        in1 = Input()
+        cmul1 = ConstantMultiplication(1, in1)
+        signal = cmul1.input(0).signals[0]
+        signal.fractional_bits = 4
+        signal.integer_bits = 2
+        signal.quantization = quantization
+        signal.overflow = overflow
+        sfg = SFG(inputs=[in1], outputs=[Output(cmul1)])
+        values = np.arange(-80, 81) / 32
+
+        simulation = _b_asic.Simulation(sfg, [values])
+        simulation.run()
+
+        expected = [quantize(value, 4, 2, quantization, overflow) for value in values]
+        assert np.array_equal(simulation.results["0"], expected)
+        assert_results_equal(simulation.results, reference_results(sfg, [values], 161))
+
+    @pytest.mark.parametrize("fractional_bits", [1, None])
+    def test_formats_per_input(self, fractional_bits):
+        in1 = Input()
+        in2 = Input()
+        add1 = Addition(in1, in2)
+        add1.input(0).signals[0].bits = 2
+        add1.input(1).signals[0].fractional_bits = fractional_bits
+        sfg = SFG(inputs=[in1, in2], outputs=[Output(add1)])
+        inputs = make_inputs(sfg)
+
+        simulation = _b_asic.Simulation(sfg, inputs)
+        simulation.run()
+
+        assert_results_equal(simulation.results, reference_results(sfg, inputs))
+
+
+class TestLanes:
+    def test_lanes_match_separate_simulations(self, sfg_direct_form_iir_lp_filter):
+        sfg = sfg_direct_form_iir_lp_filter
+        lanes = [make_inputs(sfg, seed=seed)[0] for seed in range(3)]
+
+        simulation = _b_asic.Simulation(sfg, [np.array(lanes)], lanes=3)
+        output = simulation.run()
+
+        assert simulation.lanes == 3
+        assert len(output) == 3
+        for lane, inputs in enumerate(lanes):
+            reference = reference_results(sfg, [inputs])
+            assert np.array_equal(simulation.results["0"][lane], reference["0"])
+            assert output[lane] == reference["0"][-1]
+
+    def test_wrong_number_of_lanes(self, sfg_delay):
+        with pytest.raises(ValueError):
+            _b_asic.Simulation(sfg_delay, [np.zeros((2, 10))], lanes=3)
+
+
+class TestProbesAndRecording:
+    def test_probe_outputs(self, sfg_two_inputs_two_outputs):
+        inputs = make_inputs(sfg_two_inputs_two_outputs)
+        reference = reference_results(sfg_two_inputs_two_outputs, inputs)
+
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, inputs, probes="outputs"
+        )
+        simulation.run()
+
+        assert set(simulation.results) == {"0", "1"}
+        assert_outputs_equal(sfg_two_inputs_two_outputs, simulation.results, reference)
+
+    def test_probe_patterns(self, sfg_two_inputs_two_outputs):
+        inputs = make_inputs(sfg_two_inputs_two_outputs)
+        reference = reference_results(sfg_two_inputs_two_outputs, inputs)
+
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, inputs, probes=["in*", "add1"]
+        )
+        simulation.run()
+
+        assert set(simulation.results) == {"in0", "in1", "add1"}
+        assert_results_equal(simulation.results, reference, ["in0", "in1", "add1"])
+
+    def test_unmatched_probe(self, sfg_delay):
+        simulation = _b_asic.Simulation(sfg_delay, [np.zeros(10)], probes=["none"])
+        with pytest.raises(ValueError):
+            simulation.run()
+
+    def test_ring(self, sfg_simple_filter):
+        inputs = make_inputs(sfg_simple_filter)
+        reference = reference_results(sfg_simple_filter, inputs)
+        recording = _b_asic.RecordingPolicy(_b_asic.RecordingMode.RING, length=10)
+
+        simulation = _b_asic.Simulation(
+            sfg_simple_filter, inputs, block_size=16, recording=recording
+        )
+        simulation.run()
+
+        assert np.array_equal(simulation.results["0"], reference["0"][-10:])
+
+    def test_decimate(self, sfg_simple_filter):
+        inputs = make_inputs(sfg_simple_filter)
+        reference = reference_results(sfg_simple_filter, inputs)
+        recording = _b_asic.RecordingPolicy(_b_asic.RecordingMode.DECIMATE, factor=3)
+
+        simulation = _b_asic.Simulation(
+            sfg_simple_filter, inputs, block_size=16, recording=recording
+        )
+        simulation.run()
+
+        assert np.array_equal(simulation.results["0"], reference["0"][::3])
+
+    def test_trigger(self, sfg_delay):
+        inputs = [np.where(np.arange(ITERATIONS) >= 70, 1.0, 0.0)]
+        reference = reference_results(sfg_delay, inputs)
+        recording = _b_asic.RecordingPolicy(
+            _b_asic.RecordingMode.TRIGGER,
+            trigger_key="in0",
+            level=0.5,
+            before=5,
+            after=10,
+        )
+
+        simulation = _b_asic.Simulation(
+            sfg_delay, inputs, block_size=16, recording=recording
+        )
+        simulation.run()
+
+        assert simulation.trigger_iteration == 70
+        assert np.array_equal(simulation.results["0"], reference["0"][65:80])
+
+    def test_take_results(self, sfg_simple_filter):
+        inputs = make_inputs(sfg_simple_filter)
+        reference = reference_results(sfg_simple_filter, inputs)
+
+        simulation = _b_asic.Simulation(sfg_simple_filter, inputs)
+        simulation.run()
+        results = simulation.take_results()
+
+        assert simulation.results == {}
+        assert_results_equal(results, reference)
+        results["0"][0] = 1000
+
+    def test_results_are_read_only(self, sfg_simple_filter):
+        simulation = _b_asic.Simulation(
+            sfg_simple_filter, make_inputs(sfg_simple_filter)
+        )
+        simulation.run()
+        with pytest.raises(ValueError):
+            simulation.results["0"][0] = 1000
+
+    @pytest.mark.parametrize("combined", [False, True])
+    def test_stream_results(self, tmp_path, sfg_two_inputs_two_outputs, combined):
+        inputs = make_inputs(sfg_two_inputs_two_outputs)
+        reference = reference_results(sfg_two_inputs_two_outputs, inputs)
+        path = tmp_path / ("results.npy" if combined else "results")
+
+        simulation = _b_asic.Simulation(sfg_two_inputs_two_outputs, inputs)
+        keys = simulation.stream_results(str(path), ITERATIONS, combined)
+        simulation.run(save_results=False)
+        simulation.close_stream()
+
+        assert simulation.results == {}
+        if combined:
+            streamed = np.load(path)
+            for i, key in enumerate(keys):
+                assert np.array_equal(streamed[i], reference[key])
+        else:
+            for key in keys:
+                assert np.array_equal(np.load(path / f"{key}.npy"), reference[key])
+
+
+class TestStatistics:
+    def test_graph_statistics(self, sfg_nested):
+        simulation = _b_asic.Simulation(sfg_nested)
+        statistics = simulation.graph_statistics()
+
+        assert statistics["nodes"] > 0
+        assert statistics["bytes"] > 0
+        assert statistics["bytes_per_node"] == pytest.approx(
+            statistics["bytes"] / statistics["nodes"]
+        )
+
+    @pytest.mark.parametrize("probes", ["outputs", "all"])
+    def test_optimization_statistics(self, probes):
+        in1 = Input("IN1")
+        in2 = Input("IN2")
+        constant1 = ConstantOperation(2, "C1")
+        constant2 = ConstantOperation(3, "C2")
+        # The product of the constants is folded, and the second sum is merged.
+        out1 = Output(Addition(in1, Multiplication(constant1, constant2)))
+        out2 = Output(Multiplication(Addition(in1, in2), Addition(in1, in2)))
+        sfg = SFG(inputs=[in1, in2], outputs=[out1, out2])
+        constants = {sfg.find_by_name(name)[0].graph_id for name in ("C1", "C2")}
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs, probes=probes)
+        statistics = simulation.optimization_statistics()
+        simulation.run()
+
+        assert statistics["folded"] == 1
+        assert statistics["merged"] == 1
+        if probes == "outputs":
+            # Only the folded product used the constants.
+            assert statistics["pruned"] == 2
+            assert statistics["instructions"] == 4
+            assert set(statistics["removed_keys"]) == constants
+            assert set(simulation.results) == {"0", "1"}
+        else:
+            assert statistics["pruned"] == 0
+            assert statistics["instructions"] == 6
+            assert statistics["removed_keys"] == []
+            assert constants <= set(simulation.results)
+        assert_results_equal(simulation.results, reference, simulation.results.keys())
+
+
+class TestOutputSelection:
+    def test_single_output(self, sfg_two_inputs_two_outputs):
+        inputs = make_inputs(sfg_two_inputs_two_outputs)
+        reference = reference_results(sfg_two_inputs_two_outputs, inputs)
+
+        simulation = _b_asic.Simulation(sfg_two_inputs_two_outputs, inputs)
+        output = simulation.run(save_results=False, outputs=[1])
+
+        assert output == [reference["1"][-1]]
+
+    def test_delays_keep_advancing(self, sfg_direct_form_iir_lp_filter):
+        sfg = sfg_direct_form_iir_lp_filter
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs)
+        simulation.run_for(50, save_results=False, outputs=[], advance_delays=True)
+        output = simulation.run(save_results=False)
+
+        assert output == [reference["0"][-1]]
+
+    def test_output_out_of_range(self, sfg_delay):
+        simulation = _b_asic.Simulation(sfg_delay, [np.zeros(10)])
+        with pytest.raises(IndexError):
+            simulation.step(outputs=[1])
+
+
+class TestSnapshot:
+    def test_restore(self, sfg_direct_form_iir_lp_filter):
+        sfg = sfg_direct_form_iir_lp_filter
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs)
+        simulation.run_for(60, save_results=False)
+        snapshot = simulation.snapshot()
+        first = simulation.run_for(40, save_results=False)
+        simulation.restore(snapshot)
+
+        assert simulation.iteration == 60
+        assert simulation.run_for(40, save_results=False) == first
+        assert first == [reference["0"][99]]
+
+    def test_restore_into_other_simulation(self, sfg_simple_filter):
+        inputs = make_inputs(sfg_simple_filter)
+        reference = reference_results(sfg_simple_filter, inputs)
+
+        simulation = _b_asic.Simulation(sfg_simple_filter, inputs)
+        simulation.run_for(60)
+        other = _b_asic.Simulation(sfg_simple_filter, inputs)
+        other.restore(simulation.snapshot())
+        other.run()
+
+        assert np.array_equal(other.results["0"], reference["0"][60:])
+
+    def test_restore_wrong_lanes(self, sfg_simple_filter):
+        simulation = _b_asic.Simulation(sfg_simple_filter, lanes=2)
+        other = _b_asic.Simulation(sfg_simple_filter)
+        with pytest.raises(ValueError):
+            other.restore(simulation.snapshot())
+
+    def test_restore_not_a_snapshot(self, sfg_simple_filter):
+        simulation = _b_asic.Simulation(sfg_simple_filter)
+        with pytest.raises(ValueError):
+            simulation.restore(b"not a snapshot")
+
+    def test_restore_noise_generators(self, sfg_two_inputs_two_outputs):
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, [Gaussian(1), Uniform(2)]
+        )
+        simulation.run_for(60, save_results=False)
+        snapshot = simulation.snapshot()
+        first = simulation.run_for(40, save_results=False)
+        simulation.restore(snapshot)
+
+        assert simulation.run_for(40, save_results=False) == first
+
+    def test_restore_checks_every_generator_first(self, sfg_two_inputs_two_outputs):
+        simulation = _b_asic.Simulation(
+            sfg_two_inputs_two_outputs, [Gaussian(1), Uniform(2)]
+        )
+        simulation.run_for(60)
+        snapshot = simulation.snapshot()
+
+        gaussian = Gaussian(3)
+        uniform = Uniform(4)
+        uniform._rng = np.random.Generator(np.random.MT19937(4))
+        other = _b_asic.Simulation(sfg_two_inputs_two_outputs, [gaussian, uniform])
+        state = gaussian._rng.bit_generator.state
+        with pytest.raises(ValueError):
+            other.restore(snapshot)
+
+        assert gaussian._rng.bit_generator.state == state
+        assert other.iteration == 0
+
+    def test_failed_restore_changes_nothing(self, tmp_path, sfg_two_inputs_two_outputs):
+        sfg = sfg_two_inputs_two_outputs
+        inputs = make_inputs(sfg)
+        simulation = _b_asic.Simulation(sfg, [Gaussian(1), inputs[1] * 1j])
+        simulation.run_for(60)
+        snapshot = simulation.snapshot()
+
+        gaussian = Gaussian(2)
+        other = _b_asic.Simulation(sfg, [gaussian, inputs[1]])
+        other.stream_results(str(tmp_path / "results"), ITERATIONS)
+        other.run_for(10, save_results=False)
+        state = gaussian._rng.bit_generator.state
+        # Real-valued results that are being streamed cannot become complex.
+        with pytest.raises(ValueError):
+            other.restore(snapshot)
+
+        assert gaussian._rng.bit_generator.state == state
+        assert other.iteration == 10
+
+    def test_snapshot_warns_about_python_inputs(self, sfg_two_inputs_two_outputs):
+        simulation = _b_asic.Simulation(sfg_two_inputs_two_outputs, [lambda n: n, 0])
+        with pytest.warns(RuntimeWarning, match="inputs 0"):
+            simulation.snapshot()
+
+    def test_fork(self, sfg_direct_form_iir_lp_filter):
+        sfg = sfg_direct_form_iir_lp_filter
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs)
+        simulation.run_for(60)
+        fork = simulation.fork()
+        fork.run()
+        simulation.run()
+
+        assert fork.iteration == ITERATIONS
+        assert np.array_equal(fork.results["0"], reference["0"][60:])
+        assert np.array_equal(simulation.results["0"], reference["0"])
+
+
+@pytest.fixture
+def sfg_multiply_add():
+    """SFG whose products and sums a compiler could contract to fused multiply-adds."""
+    in1 = Input("IN1")
+    in2 = Input("IN2")
+    in3 = Input("IN3")
+    mad = MAD(in1, in2, in3, "MAD1")
+    adaptor = SymmetricTwoportAdaptor(0.3, mad, in3, "SYM1")
+    out1 = Output(adaptor.output(0), "OUT1")
+    out2 = Output(adaptor.output(1), "OUT2")
+    return SFG(inputs=[in1, in2, in3], outputs=[out1, out2])
+
+
+@pytest.mark.skipif(shutil.which("c++") is None, reason="No C++ compiler")
+class TestKernel:
+    @pytest.mark.parametrize(
+        "fixture", ["sfg_multiply_add", "sfg_direct_form_iir_lp_filter"]
+    )
+    def test_matches_interpreter(self, request, tmp_path, fixture):
+        sfg = request.getfixturevalue(fixture)
+        inputs = make_inputs(sfg)
+        interpreter = _b_asic.Simulation(sfg, inputs)
+        interpreter.run_for(ITERATIONS)
+
+        options = _b_asic.KernelOptions(
+            enabled=True,
+            flags="-O3 -march=native -ffast-math",
+            cache_directory=str(tmp_path),
+        )
+        simulation = _b_asic.Simulation(sfg, inputs, kernel_options=options)
+        simulation.run_for(ITERATIONS)
+
+        assert list(tmp_path.glob("asic_kernel_*.so"))
+        assert_results_equal(simulation.results, interpreter.results)
+
+    def test_flags_are_not_run_by_a_shell(self, tmp_path, sfg_simple_filter):
+        inputs = make_inputs(sfg_simple_filter)
+        reference = reference_results(sfg_simple_filter, inputs)
+        injected = tmp_path / "injected"
+
+        options = _b_asic.KernelOptions(
+            enabled=True, flags=f"-O2 ; touch {injected}", cache_directory=str(tmp_path)
+        )
+        simulation = _b_asic.Simulation(
+            sfg_simple_filter, inputs, kernel_options=options
+        )
+        simulation.run_for(ITERATIONS)
+
+        assert not injected.exists()
+        assert_results_equal(simulation.results, reference)
+
+
+class TestStateSpace:
+    @pytest.mark.parametrize("fixture", LINEAR_SFG_FIXTURES)
+    def test_matches_simulation(self, request, fixture):
+        sfg = request.getfixturevalue(fixture)
+        inputs = make_inputs(sfg)
+        reference = reference_results(sfg, inputs)
+
+        simulation = _b_asic.Simulation(sfg, inputs, probes="outputs", state_space=True)
+        simulation.run()
+
+        for i in range(sfg.output_count):
+            assert np.allclose(simulation.results[str(i)], reference[str(i)])
+
+    def test_nonlinear_falls_back(self, sfg_accumulator):
+        inputs = [[5, 9, 25, -5, 7], [0, 0, 1, 0, 0]]
+        reference = reference_results(sfg_accumulator, inputs, 5)
+
+        simulation = _b_asic.Simulation(sfg_accumulator, inputs, state_space=True)
+        simulation.run()
+
+        assert_results_equal(simulation.results, reference)
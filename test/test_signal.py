@@ -6,6 +6,7 @@ import pytest
 
 from b_asic.core_operations import Addition, Butterfly, Constant, ConstantMultiplication
 from b_asic.port import InputPort, OutputPort
+from b_asic.quantization import Overflow, Quantization
 from b_asic.signal import Signal
 from b_asic.special_operations import Input
 
@@ -92,6 +93,48 @@ class TestBits:
         assert signal.bits is None
 
 
+class TestFixedPoint:
+    def test_defaults(self, signal):
+        assert signal.fractional_bits is None
+        assert signal.integer_bits == 1
+        assert signal.quantization is Quantization.TRUNCATION
+        assert signal.overflow is Overflow.TWOS_COMPLEMENT
+
+    def test_set_format(self, signal):
+        signal.fractional_bits = 6
+        signal.integer_bits = 3
+        signal.quantization = Quantization.ROUNDING
+        signal.overflow = Overflow.SATURATION
+        assert signal.fractional_bits == 6
+        assert signal.integer_bits == 3
+        assert signal.quantization is Quantization.ROUNDING
+        assert signal.overflow is Overflow.SATURATION
+
+    def test_reset_format(self, signal):
+        signal.fractional_bits = 6
+        signal.integer_bits = 3
+        signal.fractional_bits = None
+        signal.integer_bits = None
+        assert signal.fractional_bits is None
+        assert signal.integer_bits == 1
+
+    def test_fractional_bits_float(self, signal):
+        with pytest.raises(TypeError):
+            signal.fractional_bits = 3.2
+
+    def test_integer_bits_float(self, signal):
+        with pytest.raises(TypeError):
+            signal.integer_bits = 3.2
+
+    def test_quantization_int(self, signal):
+        with pytest.raises(TypeError):
+            signal.quantization = 1
+
+    def test_overflow_int(self, signal):
+        with pytest.raises(TypeError):
+            signal.overflow = 1
+
+
 def test_create_from_single_input_single_output():
     cm1 = ConstantMultiplication(0.5, name="Foo")
     cm2 = ConstantMultiplication(1.5, name="Bar")
@@ -136,6 +136,28 @@ def test_gaussian():
     assert str(Gaussian(1234, 1, 2)) == "Gaussian(seed=1234, loc=1, scale=2)"
 
 
+def test_gaussian_counter_based():
+    g = Gaussian(1234, counter_based=True)
+    assert g(1) == pytest.approx(0.4275866723340035)
+    assert g(0) == pytest.approx(0.5592489475752191)
+    assert g(1) == g(1)
+
+    assert str(g) == "Gaussian(seed=1234, counter_based=True)"
+
+    # Check different streams give different sequences
+    g1 = Gaussian(12345, counter_based=True)
+    g2 = Gaussian(12345, counter_based=True, stream=1)
+    assert [g1(n) for n in range(10)] != [g2(n) for n in range(10)]
+
+    assert (
+        str(Gaussian(1234, 1, 2, counter_based=True, stream=3))
+        == "Gaussian(seed=1234, loc=1, scale=2, counter_based=True, stream=3)"
+    )
+
+    with pytest.raises(ValueError):
+        Gaussian(-1, counter_based=True)
+
+
 def test_uniform():
     g = Uniform(1234)
     assert g(0) == pytest.approx(0.9533995333962844)
@@ -153,6 +175,22 @@ def test_uniform():
     assert str(Uniform(1234, 1, 2)) == "Uniform(seed=1234, low=1, high=2)"
 
 
+def test_uniform_counter_based():
+    g = Uniform(1234, counter_based=True)
+    assert g(1) == pytest.approx(-0.7754493371486515)
+    assert g(0) == pytest.approx(0.706937869604308)
+    assert g(1) == g(1)
+
+    assert str(g) == "Uniform(seed=1234, counter_based=True)"
+
+    # Check different streams give different sequences
+    g1 = Uniform(12345, counter_based=True)
+    g2 = Uniform(12345, counter_based=True, stream=1)
+    assert [g1(n) for n in range(10)] != [g2(n) for n in range(10)]
+
+    assert all(1 <= Uniform(1, 1, 2, counter_based=True)(n) < 2 for n in range(100))
+
+
 def test_addition():
     g = Impulse() + Impulse(2)
     assert g(-1) == 0
@@ -1,7 +1,15 @@
 import numpy as np
 import pytest
 
-from b_asic import Simulation
+from b_asic import (
+    SFG,
+    Addition,
+    ConstantMultiplication,
+    Input,
+    Output,
+    Simulation,
+)
+from b_asic.quantization import Overflow, Quantization, quantize
 
 
 class TestRunFor:
@@ -225,3 +233,53 @@ class TestRun:
         simulation.run_for(5)
         assert all(simulation.results["0"] == np.array([2, 4, 6, 8, 10]))
         assert all(simulation.results["1"] == np.array([2, 4, 8, 16, 32]))
+
+
+class TestFixedPoint:
+    @pytest.mark.parametrize("quantization", list(Quantization))
+    @pytest.mark.parametrize("overflow", list(Overflow))
+    def test_matches_quantize(self, quantization, overflow):
+        in1 = Input()
+        cmul1 = ConstantMultiplication(1, in1)
+        signal = cmul1.input(0).signals[0]
+        signal.fractional_bits = 4
+        signal.integer_bits = 2
+        signal.quantization = quantization
+        signal.overflow = overflow
+        sfg = SFG(inputs=[in1], outputs=[Output(cmul1)])
+        values = np.arange(-80, 81) / 32
+
+        simulation = Simulation(sfg, [values])
+        simulation.run()
+
+        expected = [quantize(value, 4, 2, quantization, overflow) for value in values]
+        assert np.array_equal(simulation.results["0"], expected)
+
+    def test_bits_override(self):
+        in1 = Input()
+        cmul1 = ConstantMultiplication(1, in1)
+        cmul1.input(0).signals[0].fractional_bits = 1
+        sfg = SFG(inputs=[in1], outputs=[Output(cmul1)])
+
+        simulation = Simulation(sfg, [[0.75]])
+        simulation.run()
+        assert list(simulation.results["0"]) == [0.5]
+
+        simulation = Simulation(sfg, [[0.75]])
+        simulation.run(bits_override=2)
+        assert list(simulation.results["0"]) == [0.75]
+
+    @pytest.mark.parametrize("fractional_bits", [1, None])
+    def test_formats_per_input(self, fractional_bits):
+        in1 = Input()
+        in2 = Input()
+        add1 = Addition(in1, in2)
+        add1.input(0).signals[0].bits = 2
+        add1.input(1).signals[0].fractional_bits = fractional_bits
+        sfg = SFG(inputs=[in1, in2], outputs=[Output(add1)])
+
+        simulation = Simulation(sfg, [[0.3], [0.3]])
+        simulation.run()
+
+        second = 0.3 if fractional_bits is None else quantize(0.3, fractional_bits)
+        assert list(simulation.results["0"]) == [0.25 + second]